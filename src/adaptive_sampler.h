@@ -0,0 +1,98 @@
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <math.h>
+#include <stdint.h>
+
+// How quickly the rate estimate forgets a burst of change once the signal calms down
+// (fraction of the gap closed per sample). Increases are taken immediately.
+#ifndef ADAPTIVE_SAMPLER_DECAY
+#define ADAPTIVE_SAMPLER_DECAY 0.25f
+#endif
+// Largest factor the interval may grow by from one sample to the next
+#ifndef ADAPTIVE_SAMPLER_MAX_GROWTH
+#define ADAPTIVE_SAMPLER_MAX_GROWTH 2.0f
+#endif
+
+// Sampling policy for one metric. It tracks how fast the signal is moving and sets the
+// next sampling interval so that holding the last value until the next sample stays
+// within errorTarget (in the metric's own units), bounded by [minInterval, maxInterval].
+// Quiet signals are sampled rarely; a sudden change drops the interval at once.
+// Pure arithmetic on caller-supplied millis, so the same class runs in the host simulator.
+class AdaptiveSampler {
+private:
+    uint32_t minInterval;
+    uint32_t maxInterval;
+    float errorTarget;
+    float rate;               // Estimated rate of change, units per second
+    float lastValue;
+    uint32_t lastSampleMillis;
+    uint32_t interval;
+    bool hasSample;
+    uint32_t sampleCount;
+
+public:
+    AdaptiveSampler(uint32_t minIntervalMs, uint32_t maxIntervalMs, float target)
+        : minInterval(minIntervalMs), maxInterval(maxIntervalMs < minIntervalMs ? minIntervalMs : maxIntervalMs),
+          errorTarget(target), rate(0), lastValue(0), lastSampleMillis(0), interval(minIntervalMs),
+          hasSample(false), sampleCount(0) {}
+
+    bool isDue(uint32_t nowMillis) const {
+        return !hasSample || nowMillis - lastSampleMillis >= interval;
+    }
+
+    // Milliseconds until the next sample is due (0 if it already is)
+    uint32_t timeUntilDue(uint32_t nowMillis) const {
+        if (isDue(nowMillis)) {
+            return 0;
+        }
+        return interval - (nowMillis - lastSampleMillis);
+    }
+
+    // Feed a new reading taken at nowMillis; returns the interval until the next one
+    uint32_t update(float value, uint32_t nowMillis) {
+        if (hasSample) {
+            uint32_t elapsed = nowMillis - lastSampleMillis;
+            if (elapsed > 0) {
+                float observed = fabsf(value - lastValue) * 1000.0f / elapsed;
+                rate = observed > rate ? observed : rate + ADAPTIVE_SAMPLER_DECAY * (observed - rate);
+            }
+        }
+
+        float next = rate > 0 ? errorTarget * 1000.0f / rate : (float)maxInterval;
+        if (hasSample) {
+            next = fminf(next, interval * ADAPTIVE_SAMPLER_MAX_GROWTH);
+        }
+        next = fminf(fmaxf(next, (float)minInterval), (float)maxInterval);
+
+        interval = (uint32_t)next;
+        lastValue = value;
+        lastSampleMillis = nowMillis;
+        hasSample = true;
+        sampleCount++;
+        return interval;
+    }
+
+    // Make the next sample due immediately (e.g. the user wants fresh readings)
+    void requestSample() {
+        interval = 0;
+    }
+
+    uint32_t getInterval() const {
+        return interval;
+    }
+
+    float getRate() const {
+        return rate;
+    }
+
+    float getLastValue() const {
+        return lastValue;
+    }
+
+    uint32_t getSampleCount() const {
+        return sampleCount;
+    }
+};
+
+#endif
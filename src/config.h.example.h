@@ -47,9 +47,82 @@
 #define ENABLE_POWER_SAVE_ON_BATTERY true
 // If set to true, device will only enter light sleep and use WiFi power saving when on battery
 // If false, power saving is always enabled regardless of charging status
+#define WIFI_RECONNECT_TIME 30000  // Bring WiFi back this long before the next metric send
 
 // Tracing Configuration
 #define ENABLE_TRACING_ON_BATTERY false  // Set to false to disable tracing when on battery
 #define TRACE_FLUSH_INTERVAL 30000  // Flush traces every 30 seconds
 
+// Capture Configuration
+#define OTEL_CAPTURE_ENABLED false  // Set to true to tee every OTLP request to serial for tools/otlp_replay
+
+// Prometheus Configuration
+#define PROMETHEUS_ENABLED false    // Set to true to serve /metrics for Prometheus scrapers
+#define PROMETHEUS_PORT    9464     // Port of the /metrics endpoint
+// #define PROMETHEUS_MAX_SLEEP 1000  // Longest light sleep (ms) while the endpoint is on; keep below the scrape timeout
+
+// Sensor Profile Configuration
+// Oversampling, filtering and repeatability of the ENV III sensors. AUTO uses high accuracy on external
+// power and the cheapest profile that still resolves the exported precision on battery.
+#define SENSOR_PROFILE SENSOR_PROFILE_AUTO   // Or SENSOR_PROFILE_HIGH_ACCURACY / _BALANCED / _LOW_POWER
+#define SENSOR_LOW_BATTERY_LEVEL 20          // Battery % below which the low power profile is forced
+
+// Adaptive Sampling Configuration
+// Read temperature, humidity and pressure as often as each signal needs instead of once per send.
+// Readings taken between sends queue in the metric batch with their own timestamps.
+#define ADAPTIVE_SAMPLING_ENABLED false
+#define SAMPLE_MIN_INTERVAL   10000    // Fastest a sensor is read while its signal is changing (ms)
+#define SAMPLE_MAX_INTERVAL   600000   // Slowest a sensor is read while its signal is flat (ms)
+#define TEMP_ERROR_TARGET     0.1      // Largest acceptable drift between readings (degrees C)
+#define HUM_ERROR_TARGET      0.5      // ...relative humidity (%)
+#define PRESSURE_ERROR_TARGET 0.1      // ...pressure (hPa)
+
+// Dual Prediction Configuration
+// Only send temperature, humidity and pressure when they leave the model shared with
+// tools/otel_reconstructor by more than the error targets above. Requires the reconstructor between
+// the device and the collector; it fills in the readings that were not sent.
+#define DUAL_PREDICTION_ENABLED false
+#define DUAL_PREDICTION_MODEL PREDICT_LINEAR_TREND     // Or PREDICT_LAST_VALUE (--model on the reconstructor)
+#define DUAL_PREDICTION_KEYFRAME_INTERVAL 900000       // Send every signal at least this often (ms, --keyframe)
+
+// Outage Retention Configuration
+// Keep readings that cannot be sent (collector down, WiFi lost) in about 14 KB of RAM: the newest at
+// full resolution, older ones as 5 minute and then hourly min/max/mean/count buckets.
+#define OTEL_RETENTION_ENABLED false
+#define OTEL_RETENTION_BACKFILL_REQUESTS 4  // Requests of retained data uploaded per send once back online
+
+// Request Timeout Configuration
+// Each endpoint's deadline follows its measured response time (smoothed time + 4x variation),
+// within these bounds (ms). The maximum is also used until an endpoint has answered once.
+// #define OTEL_TIMEOUT_MIN 1000
+// #define OTEL_TIMEOUT_MAX 10000
+
+// Mirror Collector Configuration
+// Send a copy of every request the collector above accepts to a second collector (e.g. an on-site one).
+// Off by default; an empty traces URL sends traces to the metrics URL, as for the primary.
+// The mirror retries on its own with backoff and never holds up the primary.
+#define OTEL_MIRROR_ENABLED false    // Set to true to build the mirror in (about 8 KB of spool RAM)
+#define OTEL_MIRROR_METRICS_URL ""   // e.g. "http://192.168.1.90:4318/v1/metrics"
+#define OTEL_MIRROR_TRACES_URL  ""   // e.g. "http://192.168.1.90:4318/v1/traces"
+
+// CPU Frequency Configuration
+// Run idle polling, sensor reads and display updates at CPU_LOW_MHZ and boost to CPU_BOOST_MHZ only
+// while encoding and sending. Check the saving for your intervals with tools/energy_model.
+#define CPU_GOVERNOR_ENABLED false
+// #define CPU_LOW_MHZ   80           // 80, 160 or 240; WiFi needs at least 80
+// #define CPU_BOOST_MHZ 240
+// #define MAX_METRICS 30             // Metric batch size (default 24); the build warns if adaptive sampling needs more
+
+// Sleep Analytics Configuration
+// Export duty cycle, the share of planned sleep actually slept, and histograms of sleep length per
+// wake cause and of reconnect time per radio mode. Use them to tune WIFI_RECONNECT_TIME.
+#define SLEEP_STATS_ENABLED false
+
+// Transmit Power Configuration
+// Step WiFi transmit power down while uploads keep succeeding, and back up on failures, slow uploads
+// or a weaker signal. The settled level is remembered per access point. Try it with tools/txpower_sim.
+#define TX_POWER_CONTROL_ENABLED false
+// #define TX_POWER_MIN_RSSI -65       // Signal the AP must still get from us, estimated from our RSSI (dBm)
+// #define TX_POWER_LATENCY_TARGET 1500  // Uploads slower than this (ms) count as a sign of retransmissions
+
 #endif // CONFIG_H
\ No newline at end of file
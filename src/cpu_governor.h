@@ -0,0 +1,190 @@
+#ifndef CPU_GOVERNOR_H
+#define CPU_GOVERNOR_H
+
+#include <stdint.h>
+
+// Lowest CPU clock the WiFi driver is stable at, used for idle, sensing and UI work
+#ifndef CPU_LOW_MHZ
+#define CPU_LOW_MHZ 80
+#endif
+// Clock for encoding and sending payloads
+#ifndef CPU_BOOST_MHZ
+#define CPU_BOOST_MHZ 240
+#endif
+
+// What the firmware is doing; each phase has a clock frequency
+enum CpuPhase {
+    CPU_PHASE_IDLE,       // Waiting between loop polls
+    CPU_PHASE_SENSING,    // I2C sensor and power reads - bus bound
+    CPU_PHASE_UI,         // Display updates - SPI bound
+    CPU_PHASE_EXPORT,     // Encoding and sending payloads (and TLS, if used)
+    CPU_PHASE_COUNT
+};
+
+typedef void (*CpuFrequencySetter)(uint16_t mhz);
+typedef uint32_t (*CpuClock)();
+
+// Frequency governor. Phases map to a clock frequency, and only exports get the boost
+// frequency; everything else runs at the low one. Time spent at each frequency is
+// recorded. The policy is plain code around two function pointers - one that changes the
+// clock and one that reads the time - so the host energy model (tools/energy_model) runs it
+// unchanged against a simulated clock.
+class CpuGovernor {
+public:
+    static const uint8_t MAX_LEVELS = 4;
+
+private:
+    CpuFrequencySetter setter;
+    CpuClock clock;
+    uint16_t phaseMhz[CPU_PHASE_COUNT];
+    CpuPhase phase;
+    uint16_t currentMhz;
+    uint32_t lastChange;
+    uint16_t levelMhz[MAX_LEVELS];
+    uint32_t levelMillis[MAX_LEVELS];
+    uint8_t levelCount;
+    uint32_t switches;
+    bool active;              // Phases are ignored until begin(), so a disabled governor never touches the clock
+
+    // Charge the time since the last change to the frequency that was running
+    void account() {
+        uint32_t now = clock();
+        uint32_t elapsed = now - lastChange;
+        lastChange = now;
+        for (uint8_t i = 0; i < levelCount; i++) {
+            if (levelMhz[i] == currentMhz) {
+                levelMillis[i] += elapsed;
+                return;
+            }
+        }
+        if (levelCount < MAX_LEVELS) {
+            levelMhz[levelCount] = currentMhz;
+            levelMillis[levelCount++] = elapsed;
+        }
+    }
+
+public:
+    CpuGovernor(CpuFrequencySetter frequencySetter, CpuClock timeSource, uint16_t lowMhz = CPU_LOW_MHZ,
+                uint16_t boostMhz = CPU_BOOST_MHZ)
+        : setter(frequencySetter), clock(timeSource), phase(CPU_PHASE_IDLE), currentMhz(0), lastChange(0),
+          levelCount(0), switches(0), active(false) {
+        phaseMhz[CPU_PHASE_IDLE] = lowMhz;
+        phaseMhz[CPU_PHASE_SENSING] = lowMhz;
+        phaseMhz[CPU_PHASE_UI] = lowMhz;
+        phaseMhz[CPU_PHASE_EXPORT] = boostMhz;
+    }
+
+    // Start accounting at the current clock frequency and settle into the idle phase
+    void begin(uint16_t runningMhz) {
+        currentMhz = runningMhz;
+        lastChange = clock();
+        active = true;
+        enter(CPU_PHASE_IDLE);
+    }
+
+    void setPhaseFrequency(CpuPhase target, uint16_t mhz) {
+        phaseMhz[target] = mhz;
+    }
+
+    // Switch to a phase; returns the previous one so callers can go back to it
+    CpuPhase enter(CpuPhase next) {
+        CpuPhase previous = phase;
+        phase = next;
+        uint16_t mhz = phaseMhz[next];
+        if (active && mhz != currentMhz) {
+            account();
+            setter(mhz);
+            currentMhz = mhz;
+            switches++;
+        }
+        return previous;
+    }
+
+    CpuPhase getPhase() const {
+        return phase;
+    }
+
+    uint16_t getFrequency() const {
+        return currentMhz;
+    }
+
+    uint32_t getSwitchCount() const {
+        return switches;
+    }
+
+    // Milliseconds spent at a frequency, including the current stretch
+    uint32_t getTimeAt(uint16_t mhz) {
+        if (active) {
+            account();
+        }
+        for (uint8_t i = 0; i < levelCount; i++) {
+            if (levelMhz[i] == mhz) {
+                return levelMillis[i];
+            }
+        }
+        return 0;
+    }
+
+    uint8_t getLevelCount() const {
+        return levelCount;
+    }
+
+    uint16_t getLevelFrequency(uint8_t index) const {
+        return levelMhz[index];
+    }
+};
+
+// Runs a block of code in a phase and returns to the previous phase when it ends
+class CpuPhaseScope {
+private:
+    CpuGovernor& governor;
+    CpuPhase previous;
+
+public:
+    CpuPhaseScope(CpuGovernor& cpu, CpuPhase phase) : governor(cpu), previous(cpu.enter(phase)) {}
+    ~CpuPhaseScope() {
+        governor.enter(previous);
+    }
+};
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+// Platform side of the governor. With power management built into the SDK, the boost is a
+// CPU_FREQ_MAX lock held while boosting and the PM driver picks the clock between the low
+// and boost frequencies. Without it, the clock is set directly.
+inline void applyCpuFrequency(uint16_t mhz) {
+#if CONFIG_PM_ENABLE
+    static esp_pm_lock_handle_t boostLock = nullptr;
+    static bool boosted = false;
+    if (!boostLock) {
+        esp_pm_config_esp32_t config = {};
+        config.max_freq_mhz = CPU_BOOST_MHZ;
+        config.min_freq_mhz = CPU_LOW_MHZ;
+        config.light_sleep_enable = false;
+        esp_pm_configure(&config);
+        esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "cpu_boost", &boostLock);
+    }
+    bool boost = mhz > CPU_LOW_MHZ;
+    if (boost != boosted) {
+        if (boost) {
+            esp_pm_lock_acquire(boostLock);
+        } else {
+            esp_pm_lock_release(boostLock);
+        }
+        boosted = boost;
+    }
+#else
+    setCpuFrequencyMhz(mhz);
+#endif
+}
+
+inline uint32_t cpuGovernorMillis() {
+    return millis();
+}
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef DUAL_PREDICTION_H
+#define DUAL_PREDICTION_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "numeric_value.h"
+
+// Model shared by the device and the reconstructor. LAST_VALUE holds the last report;
+// LINEAR_TREND extends the line through the last two reports.
+enum PredictionModel {
+    PREDICT_LAST_VALUE,
+    PREDICT_LINEAR_TREND
+};
+
+// Dual prediction for one metric. The device and the host-side reconstructor
+// (tools/otel_reconstructor) run the same model on the same reported points. The device
+// only reports a reading when it is further than tolerance from the model's prediction,
+// so every reading it keeps back is known to the host to within tolerance.
+//
+// A report made keyframeInterval or more after the previous one is a keyframe: the model
+// restarts from that point alone. The device reports at least once per keyframe interval,
+// so a report lost in transit can only throw the host off until the next keyframe.
+// Both sides recognise keyframes from the timestamps alone.
+//
+// Only reported values and their timestamps feed the model, and reported values are first
+// rounded exactly as the OTLP encoder prints them, so both sides compute the same predictions.
+// On the device a report only counts once the collector has accepted it: commit() after a
+// successful send, rollback() after a failed one.
+class DualPredictor {
+private:
+    PredictionModel model;
+    float tolerance;
+    uint64_t keyframeNanos;
+    float lastValue;
+    float prevValue;
+    uint64_t lastNanos;
+    uint64_t prevNanos;
+    uint8_t history;          // Reports since the last keyframe that the model uses (0-2)
+    // Model as of the last commit(), i.e. what the receiver is known to have
+    float committedLastValue;
+    float committedPrevValue;
+    uint64_t committedLastNanos;
+    uint64_t committedPrevNanos;
+    uint8_t committedHistory;
+    uint32_t reported;
+    uint32_t suppressed;
+    uint32_t keyframes;
+
+    static float millisBetween(uint64_t from, uint64_t to) {
+        return (float)((int64_t)(to - from) / 1000000);
+    }
+
+public:
+    DualPredictor(PredictionModel predictionModel, float errorTolerance, uint32_t keyframeIntervalMs)
+        : model(predictionModel), tolerance(errorTolerance),
+          keyframeNanos((uint64_t)keyframeIntervalMs * 1000000ULL), lastValue(0), prevValue(0),
+          lastNanos(0), prevNanos(0), history(0), committedLastValue(0), committedPrevValue(0),
+          committedLastNanos(0), committedPrevNanos(0), committedHistory(0), reported(0), suppressed(0),
+          keyframes(0) {}
+
+    // The value as the receiver sees it: printed with two decimals and parsed back
+    static float quantize(float value) {
+        char text[NUMERIC_VALUE_TEXT_SIZE];
+        NumericValue::formatFixed2(text, sizeof(text), value);
+        return strtof(text, nullptr);
+    }
+
+    bool hasModel() const {
+        return history > 0;
+    }
+
+    // A report at this time would restart the model
+    bool isKeyframe(uint64_t timestampNanos) const {
+        return history == 0 || timestampNanos - lastNanos >= keyframeNanos;
+    }
+
+    // Value the model expects at the given time (requires hasModel())
+    float predict(uint64_t timestampNanos) const {
+        if (model == PREDICT_LAST_VALUE || history < 2 || lastNanos == prevNanos) {
+            return lastValue;
+        }
+        float slope = (lastValue - prevValue) / millisBetween(prevNanos, lastNanos);
+        return lastValue + slope * millisBetween(lastNanos, timestampNanos);
+    }
+
+    // Whether a reading has to be sent. Does not change the model - call noteReported()
+    // once the point is actually queued, so a point that could not be queued is not assumed.
+    bool needsReport(float value, uint64_t timestampNanos) {
+        if (isKeyframe(timestampNanos)) {
+            return true;
+        }
+        float error = value - predict(timestampNanos);
+        if (error <= tolerance && error >= -tolerance) {
+            suppressed++;
+            return false;
+        }
+        return true;
+    }
+
+    // Feed a reported point into the model (the reconstructor calls this for every point it receives)
+    void noteReported(float value, uint64_t timestampNanos) {
+        if (isKeyframe(timestampNanos)) {
+            history = 0;
+            keyframes++;
+        }
+        prevValue = lastValue;
+        prevNanos = lastNanos;
+        lastValue = quantize(value);
+        lastNanos = timestampNanos;
+        if (history < 2) {
+            history++;
+        }
+        reported++;
+    }
+
+    // The reports since the last commit() reached the receiver - keep them in the model
+    void commit() {
+        committedLastValue = lastValue;
+        committedPrevValue = prevValue;
+        committedLastNanos = lastNanos;
+        committedPrevNanos = prevNanos;
+        committedHistory = history;
+    }
+
+    // The reports since the last commit() were lost - go back to the model the receiver has,
+    // so the next readings are judged against what it will actually predict
+    void rollback() {
+        lastValue = committedLastValue;
+        prevValue = committedPrevValue;
+        lastNanos = committedLastNanos;
+        prevNanos = committedPrevNanos;
+        history = committedHistory;
+    }
+
+    uint64_t getLastReportNanos() const {
+        return lastNanos;
+    }
+
+    uint64_t getKeyframeIntervalNanos() const {
+        return keyframeNanos;
+    }
+
+    uint32_t getReportedCount() const {
+        return reported;
+    }
+
+    uint32_t getSuppressedCount() const {
+        return suppressed;
+    }
+
+    uint32_t getKeyframeCount() const {
+        return keyframes;
+    }
+};
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef EXPORT_FANOUT_H
+#define EXPORT_FANOUT_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include "debug.h"
+#include "rtt_estimator.h"
+
+// Extra collectors that receive a copy of everything the primary collector accepts
+#ifndef OTEL_FANOUT_MAX_DESTINATIONS
+#define OTEL_FANOUT_MAX_DESTINATIONS 2
+#endif
+// Requests kept for destinations that are down, shared by all of them
+#ifndef OTEL_FANOUT_SPOOL_SLOTS
+#define OTEL_FANOUT_SPOOL_SLOTS 2
+#endif
+// Size of one spool slot - keep it at OTEL_MAX_PAYLOAD_BYTES or larger requests cannot be spooled
+#ifndef OTEL_FANOUT_SPOOL_BYTES
+#define OTEL_FANOUT_SPOOL_BYTES 4096
+#endif
+// Retry backoff per destination: doubles from the base after each failure, up to the max
+#ifndef OTEL_FANOUT_RETRY_BASE
+#define OTEL_FANOUT_RETRY_BASE 5000
+#endif
+#ifndef OTEL_FANOUT_RETRY_MAX
+#define OTEL_FANOUT_RETRY_MAX 300000
+#endif
+
+// Sends each encoded request to several collectors. The exporter encodes a request once and
+// hands the same buffer to every destination, so a second backend costs one more POST rather
+// than a second encode. A destination that is down or backing off gets the request in a
+// spool slot instead. One copy is shared by every destination that still needs it, with a
+// bit per destination as its reference count, and the slot is freed when the last one
+// has sent it. When the spool is full the oldest request is dropped for whoever still needs it.
+class ExportFanout {
+private:
+    struct Destination {
+        const char* metricsUrl;
+        const char* tracesUrl;
+        uint8_t failures;           // Consecutive failures, drives the backoff
+        unsigned long retryAt;      // millis() before which the destination is left alone
+        uint32_t sent;
+        uint32_t failed;
+        uint32_t dropped;           // Requests evicted from (or too large for) the spool before this destination got them
+        RttEstimator rtt;           // Deadlines follow this collector's own response times
+    };
+
+    struct SpoolSlot {
+        char payload[OTEL_FANOUT_SPOOL_BYTES];
+        size_t length;
+        char signal;                // 'M' or 'T', like capture records
+        uint8_t pending;            // Destinations that still need this request (bit per destination)
+        uint32_t sequence;          // Spooled requests are retried oldest first
+    };
+
+    Destination destinations[OTEL_FANOUT_MAX_DESTINATIONS];
+    uint8_t destinationCount;
+    SpoolSlot spool[OTEL_FANOUT_SPOOL_SLOTS];
+    uint32_t nextSequence;
+    HTTPClient http;                // Separate from the exporter's, so its keep-alive connection survives
+
+    bool isBackingOff(const Destination& destination) const {
+        return destination.failures > 0 && (long)(millis() - destination.retryAt) < 0;
+    }
+
+    bool hasSpooled(uint8_t index) const {
+        for (uint8_t i = 0; i < OTEL_FANOUT_SPOOL_SLOTS; i++) {
+            if (spool[i].pending & (1 << index)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool post(Destination& destination, char signal, const char* payload) {
+        const char* url = signal == 'T' ? destination.tracesUrl : destination.metricsUrl;
+        http.begin(url);
+        http.addHeader("Content-Type", "application/json");
+        uint32_t timeout = applyRequestTimeout(http, destination.rtt);
+        unsigned long startTime = millis();
+        int httpCode = http.POST(payload);
+        noteRequestResult(destination.rtt, httpCode, millis() - startTime, timeout);
+        http.end();
+
+        if (httpCode < 200 || httpCode >= 300) {
+            destination.failed++;
+            if (destination.failures < 16) {
+                destination.failures++;
+            }
+            unsigned long backoff = (unsigned long)OTEL_FANOUT_RETRY_BASE << (destination.failures - 1);
+            if (backoff > OTEL_FANOUT_RETRY_MAX) {
+                backoff = OTEL_FANOUT_RETRY_MAX;
+            }
+            destination.retryAt = millis() + backoff;
+            debugLog("Fan-out to %s failed (HTTP %d), retrying in %lu ms", url, httpCode, backoff);
+            return false;
+        }
+
+        destination.sent++;
+        destination.failures = 0;
+        return true;
+    }
+
+    void addToSpool(char signal, const char* payload, size_t length, uint8_t pending) {
+        if (length >= OTEL_FANOUT_SPOOL_BYTES) {
+            debugLog("Fan-out request too large to spool (%u bytes)", (unsigned)length);
+            for (uint8_t d = 0; d < destinationCount; d++) {
+                if (pending & (1 << d)) {
+                    destinations[d].dropped++;
+                }
+            }
+            return;
+        }
+
+        // Free slot, or else the oldest one
+        SpoolSlot* slot = &spool[0];
+        for (uint8_t i = 0; i < OTEL_FANOUT_SPOOL_SLOTS; i++) {
+            if (spool[i].pending == 0) {
+                slot = &spool[i];
+                break;
+            }
+            if (spool[i].sequence < slot->sequence) {
+                slot = &spool[i];
+            }
+        }
+        for (uint8_t d = 0; d < destinationCount; d++) {
+            if (slot->pending & (1 << d)) {
+                destinations[d].dropped++;
+            }
+        }
+
+        memcpy(slot->payload, payload, length);
+        slot->payload[length] = '\0';
+        slot->length = length;
+        slot->signal = signal;
+        slot->pending = pending;
+        slot->sequence = nextSequence++;
+    }
+
+public:
+    ExportFanout() : destinationCount(0), nextSequence(0) {
+        for (uint8_t i = 0; i < OTEL_FANOUT_SPOOL_SLOTS; i++) {
+            spool[i].length = 0;
+            spool[i].pending = 0;
+            spool[i].sequence = 0;
+        }
+    }
+
+    // Add a collector. Like the primary one, it takes traces on its metrics URL when no
+    // separate traces URL is given.
+    bool addDestination(const char* metricsUrl, const char* tracesUrl) {
+        if (destinationCount >= OTEL_FANOUT_MAX_DESTINATIONS) {
+            debugLog("Warning: Maximum fan-out destinations reached (%d)", OTEL_FANOUT_MAX_DESTINATIONS);
+            return false;
+        }
+        if (!metricsUrl || strlen(metricsUrl) == 0) {
+            debugLog("Warning: Fan-out destination needs a metrics URL");
+            return false;
+        }
+        if (!tracesUrl || strlen(tracesUrl) == 0) {
+            tracesUrl = metricsUrl;
+        }
+        Destination& destination = destinations[destinationCount++];
+        destination.metricsUrl = metricsUrl;
+        destination.tracesUrl = tracesUrl;
+        destination.failures = 0;
+        destination.retryAt = 0;
+        destination.sent = 0;
+        destination.failed = 0;
+        destination.dropped = 0;
+        destination.rtt = RttEstimator();
+        http.setReuse(true);
+        debugLog("Fan-out destination added: %s, %s", metricsUrl, tracesUrl);
+        return true;
+    }
+
+    uint8_t getDestinationCount() const {
+        return destinationCount;
+    }
+
+    // Hand one encoded request to every destination. Destinations with older requests still
+    // spooled, or backing off, get it queued behind them so their order is kept.
+    void dispatch(char signal, const char* payload, size_t length) {
+        uint8_t pending = 0;
+        for (uint8_t d = 0; d < destinationCount; d++) {
+            if (isBackingOff(destinations[d]) || hasSpooled(d) || !post(destinations[d], signal, payload)) {
+                pending |= 1 << d;
+            }
+        }
+        if (pending != 0) {
+            addToSpool(signal, payload, length, pending);
+        }
+    }
+
+    // Retry spooled requests for every destination whose backoff has expired, oldest first
+    void service() {
+        for (uint8_t d = 0; d < destinationCount; d++) {
+            Destination& destination = destinations[d];
+            while (!isBackingOff(destination)) {
+                SpoolSlot* oldest = nullptr;
+                for (uint8_t i = 0; i < OTEL_FANOUT_SPOOL_SLOTS; i++) {
+                    if ((spool[i].pending & (1 << d)) && (!oldest || spool[i].sequence < oldest->sequence)) {
+                        oldest = &spool[i];
+                    }
+                }
+                if (!oldest || !post(destination, oldest->signal, oldest->payload)) {
+                    break;
+                }
+                oldest->pending &= ~(1 << d);
+            }
+        }
+    }
+
+    bool hasSpooledRequests() const {
+        for (uint8_t i = 0; i < OTEL_FANOUT_SPOOL_SLOTS; i++) {
+            if (spool[i].pending != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void logStats() const {
+        for (uint8_t d = 0; d < destinationCount; d++) {
+            const Destination& destination = destinations[d];
+            debugLog("Fan-out %s: %lu sent, %lu failed (%lu timed out), %lu dropped from spool, deadline %lu ms%s",
+                     destination.metricsUrl, (unsigned long)destination.sent, (unsigned long)destination.failed,
+                     (unsigned long)destination.rtt.getTimeoutCount(), (unsigned long)destination.dropped,
+                     (unsigned long)destination.rtt.getTimeout(), isBackingOff(destination) ? " (backing off)" : "");
+        }
+    }
+};
+
+#endif
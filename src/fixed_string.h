@@ -0,0 +1,144 @@
+#ifndef FIXED_STRING_H
+#define FIXED_STRING_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Fixed-capacity, non-allocating string for status and error text.
+// Storage lives inside the object, so copies and assignments never touch the heap.
+// Anything that does not fit is truncated, and the operation reports false.
+template <size_t Capacity>
+class FixedString {
+private:
+    char data[Capacity + 1];
+    size_t len;
+
+public:
+    FixedString() : len(0) {
+        data[0] = '\0';
+    }
+
+    FixedString(const char* value) : len(0) {
+        data[0] = '\0';
+        append(value);
+    }
+
+    template <size_t OtherCapacity>
+    FixedString(const FixedString<OtherCapacity>& other) : len(0) {
+        data[0] = '\0';
+        append(other.c_str());
+    }
+
+    FixedString& operator=(const char* value) {
+        if (value != data) {
+            clear();
+            append(value);
+        }
+        return *this;
+    }
+
+    template <size_t OtherCapacity>
+    FixedString& operator=(const FixedString<OtherCapacity>& other) {
+        return *this = other.c_str();
+    }
+
+    // Append a C string; returns false if it had to be truncated
+    bool append(const char* value) {
+        if (!value) {
+            return true;
+        }
+        size_t valueLength = strlen(value);
+        size_t room = Capacity - len;
+        size_t copied = valueLength < room ? valueLength : room;
+        memcpy(data + len, value, copied);
+        len += copied;
+        data[len] = '\0';
+        return copied == valueLength;
+    }
+
+    bool append(char c) {
+        if (len >= Capacity) {
+            return false;
+        }
+        data[len++] = c;
+        data[len] = '\0';
+        return true;
+    }
+
+    // printf-style append; returns false if the output had to be truncated
+    bool appendf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        bool fits = vappendf(format, args);
+        va_end(args);
+        return fits;
+    }
+
+    bool vappendf(const char* format, va_list args) {
+        int written = vsnprintf(data + len, Capacity + 1 - len, format, args);
+        if (written < 0) {
+            data[len] = '\0';
+            return false;
+        }
+        size_t room = Capacity - len;
+        len += (size_t)written < room ? (size_t)written : room;
+        return (size_t)written <= room;
+    }
+
+    // Replace the contents with printf-style output
+    bool format(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        clear();
+        va_list args;
+        va_start(args, format);
+        bool fits = vappendf(format, args);
+        va_end(args);
+        return fits;
+    }
+
+    void clear() {
+        len = 0;
+        data[0] = '\0';
+    }
+
+    const char* c_str() const {
+        return data;
+    }
+
+    size_t length() const {
+        return len;
+    }
+
+    bool isEmpty() const {
+        return len == 0;
+    }
+
+    static constexpr size_t capacity() {
+        return Capacity;
+    }
+
+    bool equals(const char* other) const {
+        return other ? strcmp(data, other) == 0 : len == 0;
+    }
+
+    bool operator==(const char* other) const {
+        return equals(other);
+    }
+
+    bool operator!=(const char* other) const {
+        return !equals(other);
+    }
+
+    template <size_t OtherCapacity>
+    bool operator==(const FixedString<OtherCapacity>& other) const {
+        return equals(other.c_str());
+    }
+
+    template <size_t OtherCapacity>
+    bool operator!=(const FixedString<OtherCapacity>& other) const {
+        return !equals(other.c_str());
+    }
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef FLUSH_COORDINATOR_H
+#define FLUSH_COORDINATOR_H
+
+#include <Arduino.h>
+#include "debug.h"
+#include "opentelemetry.h"
+
+// Lines up all export traffic on one planned radio wake per send cycle.
+// The metric send is the mandatory wake and opens an export window. Deferrable work
+// (aged trace batches, collector health checks) waits for that window and rides along
+// instead of waking the radio on its own. A trace buffer that is about to overflow is
+// the only thing allowed to wake the radio early. A successful export proves the
+// collector is healthy, so it also counts as a health check.
+class FlushCoordinator {
+private:
+    OpenTelemetry& otel;
+    unsigned long healthCheckInterval;
+    unsigned long nextWake;
+    unsigned long lastHealthEvidence;
+    unsigned long statsStart;
+    bool healthKnown;
+    bool windowOpen;
+    uint32_t radioWakes;
+    uint32_t windowsOpened;
+    uint32_t healthChecksRun;
+    uint32_t healthChecksAbsorbed;
+    uint32_t earlyFlushes;
+
+public:
+    FlushCoordinator(OpenTelemetry& telemetry, unsigned long healthInterval)
+        : otel(telemetry), healthCheckInterval(healthInterval), nextWake(0), lastHealthEvidence(0),
+          statsStart(0), healthKnown(false), windowOpen(false), radioWakes(0), windowsOpened(0),
+          healthChecksRun(0), healthChecksAbsorbed(0), earlyFlushes(0) {}
+
+    void begin() {
+        statsStart = millis();
+    }
+
+    // Plan the next mandatory wake; pending spans get it as their flush deadline
+    void planNextWake(unsigned long wakeMillis) {
+        nextWake = wakeMillis;
+        otel.setFlushDeadline(wakeMillis);
+    }
+
+    unsigned long getNextWake() const {
+        return nextWake;
+    }
+
+    // Whether the radio should be up: inside a window, when the next planned wake is within
+    // leadTime (so there is time to reconnect), or when the trace buffer cannot wait
+    bool isRadioNeeded(unsigned long leadTime) const {
+        return windowOpen || (long)(nextWake - millis()) <= (long)leadTime || otel.isTraceBatchFull();
+    }
+
+    // Count a transition of the radio from sleep (or disconnected) to fully awake
+    void noteRadioWake() {
+        radioWakes++;
+    }
+
+    // Open the export window for the mandatory send; everything due drains inside it
+    void openWindow() {
+        windowOpen = true;
+        windowsOpened++;
+    }
+
+    void closeWindow() {
+        windowOpen = false;
+    }
+
+    bool isWindowOpen() const {
+        return windowOpen;
+    }
+
+    // Outside a window, traces only go out early if the buffer is full, or when the
+    // radio is already fully awake and the batch processor wants a flush anyway
+    bool shouldFlushTracesNow(bool radioAwake) {
+        if (windowOpen || !otel.hasPendingSpans()) {
+            return false;
+        }
+        if (otel.isTraceBatchFull()) {
+            earlyFlushes++;
+            debugLog("Trace buffer full (%lu bytes) - flushing ahead of the next wake",
+                     (unsigned long)otel.getPendingTraceBytes());
+            return true;
+        }
+        return radioAwake && otel.shouldFlushTraces();
+    }
+
+    // Record the result of an export; a successful one doubles as a health check
+    void noteExport(bool success) {
+        if (success) {
+            lastHealthEvidence = millis();
+            healthKnown = true;
+            healthChecksAbsorbed++;
+        }
+    }
+
+    void noteHealthCheck(bool success) {
+        healthChecksRun++;
+        if (success) {
+            lastHealthEvidence = millis();
+            healthKnown = true;
+        }
+    }
+
+    // A health check is due once nothing has proven the collector healthy for a full
+    // interval. It only runs inside a window, or when the radio is already awake.
+    bool isHealthCheckDue(bool radioAwake) const {
+        bool stale = !healthKnown || (millis() - lastHealthEvidence >= healthCheckInterval);
+        return stale && (windowOpen || radioAwake);
+    }
+
+    uint32_t getRadioWakes() const {
+        return radioWakes;
+    }
+
+    // Radio wakes per hour since begin()
+    float getRadioWakesPerHour() const {
+        unsigned long elapsed = millis() - statsStart;
+        if (elapsed < 60000) {
+            return 0;
+        }
+        return radioWakes * 3600000.0f / elapsed;
+    }
+
+    void logStats() const {
+        debugLog("Flush coordinator: %lu radio wakes (%.1f/h), %lu windows, %lu early trace flushes, "
+                 "%lu health checks run, %lu covered by exports",
+                 (unsigned long)radioWakes, getRadioWakesPerHour(), (unsigned long)windowsOpened,
+                 (unsigned long)earlyFlushes, (unsigned long)healthChecksRun,
+                 (unsigned long)healthChecksAbsorbed);
+    }
+};
+
+#endif
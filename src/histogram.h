@@ -0,0 +1,78 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Most explicit bucket bounds one histogram can have (it has one more bucket than bounds)
+#ifndef HISTOGRAM_MAX_BOUNDS
+#define HISTOGRAM_MAX_BOUNDS 8
+#endif
+
+// Explicit-bucket histogram, the OTLP kind: bucket i counts values up to and including
+// bounds[i], and the last bucket everything above. Values are whole units (milliseconds), so
+// the sum stays exact however long the device runs and the encoder needs no float formatting.
+// `bounds` is usually a static table and is not copied. Counts only grow, so the histogram is
+// exported as cumulative.
+struct Histogram {
+    const uint32_t* bounds;
+    uint8_t boundCount;
+    uint32_t bucketCounts[HISTOGRAM_MAX_BOUNDS + 1];
+    uint32_t count;
+    uint64_t sum;
+    uint32_t min;
+    uint32_t max;
+
+    Histogram() : bounds(nullptr), boundCount(0) {
+        reset();
+    }
+
+    Histogram(const uint32_t* explicitBounds, uint8_t explicitBoundCount)
+        : bounds(explicitBounds),
+          boundCount(explicitBoundCount > HISTOGRAM_MAX_BOUNDS ? HISTOGRAM_MAX_BOUNDS : explicitBoundCount) {
+        reset();
+    }
+
+    void reset() {
+        for (uint8_t i = 0; i <= HISTOGRAM_MAX_BOUNDS; i++) {
+            bucketCounts[i] = 0;
+        }
+        count = 0;
+        sum = 0;
+        min = 0;
+        max = 0;
+    }
+
+    void record(uint32_t value) {
+        uint8_t bucket = 0;
+        while (bucket < boundCount && value > bounds[bucket]) {
+            bucket++;
+        }
+        bucketCounts[bucket]++;
+        if (count == 0 || value < min) {
+            min = value;
+        }
+        if (count == 0 || value > max) {
+            max = value;
+        }
+        count++;
+        sum += value;
+    }
+
+    // Smallest bucket bound at or above the given share of values (0..1); max above the last bound
+    uint32_t quantileBound(float quantile) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint32_t wanted = (uint32_t)(quantile * count + 0.5f);
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < boundCount; i++) {
+            seen += bucketCounts[i];
+            if (seen >= wanted) {
+                return bounds[i] < max ? bounds[i] : max;
+            }
+        }
+        return max;
+    }
+};
+
+#endif
@@ -5,8 +5,26 @@
 #include <esp_wifi.h>
 #include <esp_sleep.h>
 #include <esp_task_wdt.h>
+
+#ifdef QEMU_TARGET
+// Emulator build ([env:qemu]): Ethernet stands in for WiFi and the sensors are scripted
+#include "qemu/qemu_target.h"
+QemuNetwork qemuNetwork;
+#define WiFi qemuNetwork
+#endif
+
 #include "debug.h"
 #include "opentelemetry.h"
+#include "prometheus_server.h"
+#include "flush_coordinator.h"
+#include "fixed_string.h"
+#include "adaptive_sampler.h"
+#include "dual_prediction.h"
+#include "metric_retention.h"
+#include "cpu_governor.h"
+#include "sensor_profiles.h"
+#include "tx_power_controller.h"
+#include "sleep_stats.h"
 #include "config.h"
 
 // Default watchdog timeout is 5 seconds
@@ -49,9 +67,112 @@
 #ifndef WIFI_CHECK_INTERVAL
 #define WIFI_CHECK_INTERVAL 1000    // Check WiFi status every second
 #endif
+#ifndef OTEL_HEALTH_URL
+#define OTEL_HEALTH_URL "http://" OTEL_HOST ":13133"  // Collector health_check extension
+#endif
 #ifndef OTEL_PING_INTERVAL
 #define OTEL_PING_INTERVAL 30000    // Check OTel collector health every 30 seconds
 #endif
+#ifndef WIFI_RECONNECT_TIME
+#define WIFI_RECONNECT_TIME 30000   // Time to reconnect, stabilize and verify WiFi before a send
+#endif
+
+// Optional Prometheus pull endpoint serving /metrics from the device
+#ifndef PROMETHEUS_ENABLED
+#define PROMETHEUS_ENABLED false
+#endif
+#ifndef PROMETHEUS_PORT
+#define PROMETHEUS_PORT 9464
+#endif
+// Longest light sleep while the endpoint is on. The CPU is halted during light sleep, so a
+// scrape waits up to this long; keep it far below the scraper's timeout (10 s by default).
+#ifndef PROMETHEUS_MAX_SLEEP
+#define PROMETHEUS_MAX_SLEEP 1000
+#endif
+
+// Adaptive sampling: read each sensor as often as its signal needs, between sends
+#ifndef ADAPTIVE_SAMPLING_ENABLED
+#define ADAPTIVE_SAMPLING_ENABLED false
+#endif
+#ifndef SAMPLE_MIN_INTERVAL
+#define SAMPLE_MIN_INTERVAL 10000    // Fastest a sensor is read while its signal is changing
+#endif
+#ifndef SAMPLE_MAX_INTERVAL
+#define SAMPLE_MAX_INTERVAL 600000   // Slowest a sensor is read while its signal is flat
+#endif
+#ifndef TEMP_ERROR_TARGET
+#define TEMP_ERROR_TARGET 0.1        // Largest acceptable drift between readings, degrees C
+#endif
+#ifndef HUM_ERROR_TARGET
+#define HUM_ERROR_TARGET 0.5         // Percent relative humidity
+#endif
+#ifndef PRESSURE_ERROR_TARGET
+#define PRESSURE_ERROR_TARGET 0.1    // hPa
+#endif
+
+// Dual prediction: only send temperature, humidity and pressure when they leave the shared model
+#ifndef DUAL_PREDICTION_ENABLED
+#define DUAL_PREDICTION_ENABLED false
+#endif
+#ifndef DUAL_PREDICTION_MODEL
+#define DUAL_PREDICTION_MODEL PREDICT_LINEAR_TREND
+#endif
+#ifndef DUAL_PREDICTION_KEYFRAME_INTERVAL
+#define DUAL_PREDICTION_KEYFRAME_INTERVAL 900000  // Report every signal at least this often (ms)
+#endif
+
+// Keep readings that cannot be sent in tiered raw / 5 minute / hourly storage
+#ifndef OTEL_RETENTION_ENABLED
+#define OTEL_RETENTION_ENABLED false
+#endif
+#ifndef OTEL_RETENTION_BACKFILL_REQUESTS
+#define OTEL_RETENTION_BACKFILL_REQUESTS 4  // Requests of retained data sent per export window
+#endif
+
+// Sensor measurement profile
+#ifndef SENSOR_PROFILE
+#define SENSOR_PROFILE SENSOR_PROFILE_AUTO  // Or a fixed SENSOR_PROFILE_HIGH_ACCURACY/BALANCED/LOW_POWER
+#endif
+
+// Run idle, sensing and display work at CPU_LOW_MHZ and boost to CPU_BOOST_MHZ only for exports
+#ifndef CPU_GOVERNOR_ENABLED
+#define CPU_GOVERNOR_ENABLED false
+#endif
+
+// Record every light sleep and export duty cycle, wake causes and reconnect times
+#ifndef SLEEP_STATS_ENABLED
+#define SLEEP_STATS_ENABLED false
+#endif
+
+// Lower WiFi transmit power while uploads keep succeeding, per access point
+#ifndef TX_POWER_CONTROL_ENABLED
+#define TX_POWER_CONTROL_ENABLED false
+#endif
+
+// Metric slots kept free for the values added at every send: six always, plus the optional ones
+#ifndef SAMPLE_RESERVED_METRICS
+#define SAMPLE_RESERVED_METRICS (6 + (TX_POWER_CONTROL_ENABLED ? 1 : 0) + (SLEEP_STATS_ENABLED ? 2 : 0))
+#endif
+// Readings a changing signal adds in one send interval: three per sampling round at the fastest
+// rate, counting the round at the send itself. If they do not fit, the batch fills and forces an
+// early send - an extra radio wake - just when the signal is moving.
+#define SAMPLE_WINDOW_METRICS (3 * (OTEL_SEND_INTERVAL / SAMPLE_MIN_INTERVAL + 1))
+#if ADAPTIVE_SAMPLING_ENABLED && SAMPLE_WINDOW_METRICS + SAMPLE_RESERVED_METRICS > MAX_METRICS
+#warning "MAX_METRICS cannot hold a send interval of adaptive samples; raise it or SAMPLE_MIN_INTERVAL"
+#endif
+
+// Optional second collector that receives a copy of everything the primary one accepts
+#ifndef OTEL_MIRROR_ENABLED
+#define OTEL_MIRROR_ENABLED false
+#endif
+#ifndef OTEL_MIRROR_METRICS_URL
+#define OTEL_MIRROR_METRICS_URL ""
+#endif
+#ifndef OTEL_MIRROR_TRACES_URL
+#define OTEL_MIRROR_TRACES_URL ""
+#endif
+static_assert(OTEL_MIRROR_ENABLED || sizeof(OTEL_MIRROR_METRICS_URL) == 1,
+              "OTEL_MIRROR_METRICS_URL is set but OTEL_MIRROR_ENABLED is false");
 
 // Button pin definitions for M5Stack
 #ifndef BUTTON_A_PIN
@@ -70,15 +191,64 @@ unsigned long last_activity_time = 0;
 unsigned long last_otel_send_time = 0;
 bool otel_initialized = false;
 bool has_sent_first_metrics = false;
-String lastOtelError = "";
-int last_rssi = 0;  // Track last WiFi signal strength
+FixedString<OTEL_ERROR_MESSAGE_SIZE> lastOtelError;
 
 // OpenTelemetry instance
 OpenTelemetry otel;
 
+// Prometheus scrape endpoint - only started when PROMETHEUS_ENABLED is set
+PrometheusServer promServer(otel, PROMETHEUS_PORT);
+
+// Aligns trace flushes and health checks with the metric send so the radio wakes once per cycle
+FlushCoordinator flushCoordinator(otel, OTEL_PING_INTERVAL);
+
+// Health check deadline, learned like the exporter's own per-endpoint ones
+RttEstimator healthRtt;
+
 // Create instance of the ENV III sensor unit
-SHT3X sht3x;  // Humidity sensor in the ENVIII module
+#ifdef QEMU_TARGET
+QemuSHT3X sht3x;  // Scripted stand-ins under the emulator
+QemuQMP6988 qmp;
+#else
+Sht3xSensor sht3x;  // Humidity sensor in the ENVIII module
 QMP6988 qmp;  // Temp and pressure sensor in the ENV3 module
+#endif
+
+// Measurement settings of both sensors, picked by updateSensorProfile()
+SensorProfileId sensor_profile = SENSOR_PROFILE_BALANCED;
+bool sensor_profile_applied = false;
+
+// Per-signal sampling policies, used when ADAPTIVE_SAMPLING_ENABLED is set
+AdaptiveSampler tempSampler(SAMPLE_MIN_INTERVAL, SAMPLE_MAX_INTERVAL, TEMP_ERROR_TARGET);
+AdaptiveSampler humSampler(SAMPLE_MIN_INTERVAL, SAMPLE_MAX_INTERVAL, HUM_ERROR_TARGET);
+AdaptiveSampler pressureSampler(SAMPLE_MIN_INTERVAL, SAMPLE_MAX_INTERVAL, PRESSURE_ERROR_TARGET);
+
+// Per-signal models shared with tools/otel_reconstructor, used when DUAL_PREDICTION_ENABLED is set
+DualPredictor tempPredictor(DUAL_PREDICTION_MODEL, TEMP_ERROR_TARGET, DUAL_PREDICTION_KEYFRAME_INTERVAL);
+DualPredictor humPredictor(DUAL_PREDICTION_MODEL, HUM_ERROR_TARGET, DUAL_PREDICTION_KEYFRAME_INTERVAL);
+DualPredictor pressurePredictor(DUAL_PREDICTION_MODEL, PRESSURE_ERROR_TARGET, DUAL_PREDICTION_KEYFRAME_INTERVAL);
+bool sample_batch_full = false;  // Sampled readings filled the metric batch; send early
+
+#if OTEL_RETENTION_ENABLED
+// Readings from outages, uploaded coarsest first once the collector is reachable again
+MetricRetention metricRetention;
+#endif
+
+#if OTEL_MIRROR_ENABLED
+// Extra collectors fed from the same encoded requests as the primary one
+ExportFanout exportFanout;
+#endif
+
+// Picks the CPU clock for what the loop is doing; inactive unless CPU_GOVERNOR_ENABLED
+CpuGovernor cpuGovernor(applyCpuFrequency, cpuGovernorMillis);
+
+// Settled transmit power per access point; inactive unless TX_POWER_CONTROL_ENABLED
+TxPowerController txPowerController;
+
+// Sleep episodes and reconnect times. Always recorded; exported if SLEEP_STATS_ENABLED.
+SleepTracker sleepTracker;
+uint64_t sleep_stats_start_nanos = 0;  // Start of the cumulative histograms (boot, in wall clock time)
+unsigned long last_offline_reading = 0;  // Track last reading recorded while WiFi was down
 
 // Setup vars to receive sensor data and track connection
 float temp = 0.0;
@@ -88,11 +258,10 @@ int g_battery_level = 0;
 float g_battery_voltage = 0.0;
 bool g_is_charging = false;
 int upload_fail_count = 0;
-unsigned long last_wifi_reconnect = 0;
 unsigned long last_wifi_check = 0;
-bool wifi_was_connected = false;
 unsigned long last_wifi_ping = 0;
 bool wifi_ping_success = false;
+bool radio_parked = false;  // WiFi deliberately left off until the next export window
 unsigned long last_otel_send = 0;  // Track last time metrics were sent
 unsigned long last_sensor_query = 0;  // Track last time sensors were queried
 uint64_t sensor_reading_timestamp = 0; // Timestamp when sensors were last read
@@ -129,8 +298,14 @@ bool display_needs_full_refresh = true;
 #define SPAN_DEBUG_INTERVAL 30000  // Log span stats every 30 seconds
 #endif
 
+// Tee every encoded OTLP request to the serial port for tools/otlp_replay
+#ifndef OTEL_CAPTURE_ENABLED
+#define OTEL_CAPTURE_ENABLED false
+#endif
+
 // In the global variables section, add:
 unsigned long last_trace_flush = 0;  // Track last time traces were flushed
+bool last_trace_flush_failed = false;  // Back off to TRACE_FLUSH_INTERVAL after a failed flush
 unsigned long last_span_debug = 0;   // Track last time we logged span stats
 
 // First, let's add a custom time provider function that uses the RTC
@@ -141,6 +316,15 @@ uint64_t getDeviceTimeNanos() {
     return (uint64_t)tv.tv_sec * 1000000000ULL + (uint64_t)tv.tv_usec * 1000ULL;
 }
 
+// Format the current IP address without going through a heap-allocated String
+// The result stays valid until the next call
+const char* localIpString() {
+    static FixedString<15> ip;
+    IPAddress address = WiFi.localIP();
+    ip.format("%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+    return ip.c_str();
+}
+
 // Function to configure power management settings for better battery life
 void configurePowerManagement() {
     debugLog("Configuring power management for optimal battery life");
@@ -184,7 +368,8 @@ void enterLightSleep(uint32_t sleep_time_ms) {
     // 1. Power saving enabled
     // 2. Metrics interval >= 60 seconds (for short intervals, keep WiFi connected)
     // 3. Sleep time > 5 seconds (for very short sleeps, not worth disconnecting)
-    bool should_disable_wifi = enable_power_saving && 
+    // 4. No Prometheus endpoint (scrapers need the device to stay reachable)
+    bool should_disable_wifi = enable_power_saving && !PROMETHEUS_ENABLED &&
                                (OTEL_SEND_INTERVAL >= 60000 && sleep_time_ms > 5000);
     
     // Get power state before sleep for comparison
@@ -208,6 +393,13 @@ void enterLightSleep(uint32_t sleep_time_ms) {
         WiFi.setSleep(false);
     }
     
+    SleepRadioMode radio_mode = should_disable_wifi ? SLEEP_RADIO_OFF
+                              : enable_power_saving ? SLEEP_RADIO_MODEM : SLEEP_RADIO_ACTIVE;
+    sleepTracker.beginSleep(sleep_time_ms, radio_mode, millis());
+    
+#ifdef QEMU_TARGET
+    qemuLightSleep(sleep_time_ms);
+#else
     // Configure wake sources for light sleep
     esp_sleep_enable_timer_wakeup(sleep_time_ms * 1000); // Convert to microseconds
     
@@ -219,22 +411,25 @@ void enterLightSleep(uint32_t sleep_time_ms) {
     
     // Enter light sleep mode - execution stops here until wake
     esp_light_sleep_start();
+#endif
     
     // Get wake reason
     esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
-    String reason_str;
+    SleepWakeCause wake_cause;
     
     switch (wakeup_reason) {
         case ESP_SLEEP_WAKEUP_TIMER:
-            reason_str = "timer";
+            wake_cause = SLEEP_WAKE_TIMER;
             break;
         case ESP_SLEEP_WAKEUP_GPIO:
-            reason_str = "button";
+            wake_cause = SLEEP_WAKE_BUTTON;
             break;
         default:
-            reason_str = "other";
+            wake_cause = SLEEP_WAKE_OTHER;
             break;
     }
+    const char* reason_str = sleepWakeCauseName(wake_cause);
+    const SleepEpisode* episode = sleepTracker.endSleep(wake_cause, millis());
     
     // Get power state after sleep for comparison
     int post_sleep_battery = power.getBatteryLevel();
@@ -242,14 +437,31 @@ void enterLightSleep(uint32_t sleep_time_ms) {
     int battery_change = post_sleep_battery - pre_sleep_battery;
     
     debugLog("Woke up from light sleep (reason: %s, battery: %d%% -> %d%%, change: %d%%)", 
-             reason_str.c_str(), pre_sleep_battery, post_sleep_battery, battery_change);
+             reason_str, pre_sleep_battery, post_sleep_battery, battery_change);
+    if (episode) {
+        debugLog("Sleep episode: planned %lu ms, slept %lu ms, wake %s, radio %s",
+                 (unsigned long)episode->plannedMs, (unsigned long)episode->actualMs, reason_str,
+                 sleepRadioModeName(episode->radioMode));
+    }
     
     // Always feed watchdog right after waking
     esp_task_wdt_reset();
     
+    // Only bring the radio back when an export window is close (or the user pressed a button);
+    // otherwise it stays down and the next wake checks again
+    bool radio_needed = wakeup_reason != ESP_SLEEP_WAKEUP_TIMER ||
+                        flushCoordinator.isRadioNeeded(WIFI_RECONNECT_TIME);
+    
     // Handle WiFi reconnection if needed
-    if (should_disable_wifi) {
+    if (should_disable_wifi && !radio_needed) {
+        radio_parked = true;
+        debugLog("WiFi left off until the next export window (%lu ms away)",
+                 flushCoordinator.getNextWake() - millis());
+    } else if (should_disable_wifi) {
         debugLog("Restoring WiFi after sleep");
+        radio_parked = false;
+        flushCoordinator.noteRadioWake();
+        sleepTracker.beginReconnect(SLEEP_RADIO_OFF, millis());
         WiFi.mode(WIFI_STA);
         WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
         
@@ -268,20 +480,30 @@ void enterLightSleep(uint32_t sleep_time_ms) {
         }
         
         if (reconnected) {
+            sleepTracker.noteConnected(millis());
             debugLog("WiFi successfully reconnected after sleep in %llu ms", millis() - start_time);
         } else {
             debugLog("Initial WiFi reconnection failed after sleep");
         }
     } else {
         // For modem sleep mode, check if the connection was maintained
-        if (WiFi.status() == WL_CONNECTED) {
+        if (WiFi.status() == WL_CONNECTED && !radio_needed) {
+            debugLog("WiFi connection maintained during sleep, modem left asleep until the next export window");
+        } else if (WiFi.status() == WL_CONNECTED) {
             debugLog("WiFi connection maintained during sleep");
             // Explicitly wake up the WiFi modem from sleep mode
+            if (WiFi.getSleep()) {
+                flushCoordinator.noteRadioWake();
+                sleepTracker.beginReconnect(SLEEP_RADIO_MODEM, millis());
+            }
             WiFi.setSleep(false);
+            sleepTracker.noteConnected(millis());
             debugLog("WiFi modem woken up from sleep mode");
         } else {
             debugLog("WiFi connection lost during sleep despite modem sleep mode");
             // Try to reconnect since connection was lost
+            flushCoordinator.noteRadioWake();
+            sleepTracker.beginReconnect(radio_mode, millis());
             WiFi.setSleep(false);
             WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
             
@@ -299,6 +521,7 @@ void enterLightSleep(uint32_t sleep_time_ms) {
             }
             
             if (reconnected) {
+                sleepTracker.noteConnected(millis());
                 debugLog("WiFi successfully reconnected after modem sleep in %llu ms", millis() - start_time);
             } else {
                 debugLog("WiFi reconnection failed after modem sleep");
@@ -314,9 +537,9 @@ void enterLightSleep(uint32_t sleep_time_ms) {
 
 // Function to display status with color
 void displayStatus(const char* label, bool isOk, const char* message) {
-    static String lastLabels[5];
+    static FixedString<16> lastLabels[5];
     static bool lastStates[5];
-    static String lastMessages[5];
+    static FixedString<32> lastMessages[5];
     static int statusCount = 0;
     
     // Find if we've seen this label before
@@ -336,7 +559,7 @@ void displayStatus(const char* label, bool isOk, const char* message) {
             labelIndex = statusCount;
             lastLabels[labelIndex] = label;
             lastStates[labelIndex] = !isOk;  // Force it to be different to trigger logging
-            lastMessages[labelIndex] = "";
+            lastMessages[labelIndex].clear();
             statusCount++;
             statusChanged = true;
         }
@@ -362,6 +585,7 @@ void displayStatus(const char* label, bool isOk, const char* message) {
 
 // Function to display the main sensor readings screen
 void displayMainScreen() {
+    CpuPhaseScope cpuPhase(cpuGovernor, CPU_PHASE_UI);
     bool wifi_connected = (WiFi.status() == WL_CONNECTED);
     
     // Only do a full redraw if this is the first time or if the screen was changed
@@ -445,7 +669,7 @@ void displayMainScreen() {
         M5.Display.setCursor(0, 130);
         char batt_status[32];
         snprintf(batt_status, sizeof(batt_status), "%d%% %.1fV %s", 
-                 g_battery_level, g_battery_voltage/1000.0, 
+                 g_battery_level, g_battery_voltage/1000.0f, 
                  g_is_charging ? "(Charging)" : "");
         
         M5.Display.setTextColor(g_battery_level > 20 ? GREEN : RED);
@@ -459,6 +683,7 @@ void displayMainScreen() {
 
 // Function to display Network information screen
 void displayNetworkScreen() {
+    CpuPhaseScope cpuPhase(cpuGovernor, CPU_PHASE_UI);
     if (display_needs_full_refresh) {
         M5.Display.fillScreen(BLACK);
         display_needs_full_refresh = false;
@@ -481,7 +706,7 @@ void displayNetworkScreen() {
         
         M5.Display.setCursor(0, 45);
         M5.Display.setTextColor(WHITE, BLACK);
-        M5.Display.printf("IP: %s", WiFi.localIP().toString().c_str());
+        M5.Display.printf("IP: %s", localIpString());
         
         M5.Display.setCursor(0, 60);
         
@@ -524,8 +749,9 @@ void displayNetworkScreen() {
 
 // Function to display OpenTelemetry details
 void displayOtelScreen() {
+    CpuPhaseScope cpuPhase(cpuGovernor, CPU_PHASE_UI);
     static int prev_otel_fail_count = -1;
-    static String prev_error_message = "";
+    static FixedString<OTEL_ERROR_MESSAGE_SIZE> prev_error_message;
     
     // Only clear and redraw header if it's a full refresh
     if (display_needs_full_refresh) {
@@ -622,13 +848,15 @@ void handleButtons() {
 bool pingTest() {
     debugLog("Checking OTel Collector Health to verify network connectivity");
     HTTPClient http;
-    http.setTimeout(5000);
+    uint32_t timeout = applyRequestTimeout(http, healthRtt);
     
     // The health endpoint of the OpenTelemetry collector
-    String healthUrl = "http://" + String(OTEL_HOST) + ":13133";
-    http.begin(healthUrl);
+    http.begin(OTEL_HEALTH_URL);
+    otel.addTraceHeaders(http);  // Link the collector side to the active device span
     
+    unsigned long start = millis();
     int httpCode = http.GET();
+    noteRequestResult(healthRtt, httpCode, millis() - start, timeout);
     bool success = false;
     
     if (httpCode > 0) {
@@ -640,133 +868,15 @@ bool pingTest() {
             debugLog("Health check returned non-OK status: %d", httpCode);
         }
     } else {
-        debugLog("Health check failed: %s", http.errorToString(httpCode).c_str());
+        debugLog("Health check failed: %s (deadline %lu ms)", http.errorToString(httpCode).c_str(),
+                 (unsigned long)timeout);
     }
     
     http.end();
+    flushCoordinator.noteHealthCheck(success);
     return success;
 }
 
-// Function to check WiFi status and handle state changes
-bool checkWiFiConnection() {
-    bool currently_connected = (WiFi.status() == WL_CONNECTED);
-    
-    // Log detailed WiFi status for debugging
-    if (currently_connected) {
-        int current_rssi = WiFi.RSSI();
-        if (current_rssi != last_rssi) {
-            debugLog("WiFi RSSI changed: %d dBm", current_rssi);
-            last_rssi = current_rssi;
-        }
-    }
-
-    // Only perform ping test if WiFi shows connected
-    if (currently_connected && (millis() - last_wifi_ping > OTEL_PING_INTERVAL)) {
-        // Enable full WiFi power before performing health check
-        WiFi.setSleep(false);
-        debugLog("Performing OTEL health check...");
-        wifi_ping_success = pingTest();
-        last_wifi_ping = millis();
-        
-        // Check if power saving should be enabled
-        bool enable_power_saving = shouldEnablePowerSaving();
-        
-        // Re-enable modem sleep to save power only if:
-        // 1. Power saving is enabled
-        // 2. Metrics interval is >= 60 seconds
-        if (enable_power_saving && OTEL_SEND_INTERVAL >= 60000) {
-            WiFi.setSleep(true);
-            debugLog("WiFi returned to sleep mode after health check (power saving enabled)");
-        } else {
-            if (!enable_power_saving) {
-                debugLog("WiFi kept active after health check (power saving disabled)");
-            } else {
-                debugLog("WiFi kept active after health check (metrics interval < 60s)");
-            }
-        }
-        
-        if (!wifi_ping_success) {
-            debugLog("OTEL health check failed while WiFi connected (status: %d)", WiFi.status());
-        }
-    }
-    
-    // Consider connection lost only if:
-    // 1. WiFi is disconnected OR
-    // 2. WiFi is connected but we've failed multiple ping tests
-    static int consecutive_ping_failures = 0;
-    if (!currently_connected) {
-        consecutive_ping_failures = 0;  // Reset counter when WiFi is disconnected
-    } else if (!wifi_ping_success) {
-        consecutive_ping_failures++;
-        debugLog("Consecutive ping failures: %d", consecutive_ping_failures);
-    } else {
-        consecutive_ping_failures = 0;  // Reset on successful ping
-    }
-    
-    bool connection_lost = !currently_connected || (consecutive_ping_failures >= 3);
-    
-    // Check if state changed
-    if (connection_lost != !wifi_was_connected) {
-        if (!connection_lost) {
-            debugLog("WiFi connected! IP: %s, RSSI: %d dBm", 
-                    WiFi.localIP().toString().c_str(), 
-                    WiFi.RSSI());
-            // Enable modem sleep to save power when connected but idle, only if metrics interval is >= 60 seconds
-            if (OTEL_SEND_INTERVAL >= 60000) {
-                WiFi.setSleep(true);
-                debugLog("WiFi set to sleep mode (metrics interval >= 60s)");
-            } else {
-                WiFi.setSleep(false);
-                debugLog("WiFi kept active (metrics interval < 60s)");
-            }
-        } else {
-            debugLog("WiFi connection lost! Details:");
-            debugLog("- WiFi Status: %d", WiFi.status());
-            debugLog("- IP Address: %s", WiFi.localIP().toString().c_str());
-            debugLog("- RSSI: %d dBm", WiFi.RSSI());
-            debugLog("- Ping Success: %s", wifi_ping_success ? "Yes" : "No");
-            debugLog("- Consecutive Failures: %d", consecutive_ping_failures);
-        }
-        wifi_was_connected = !connection_lost;
-    }
-    
-    // Handle reconnection if needed
-    if (connection_lost) {
-        if (millis() - last_wifi_reconnect > WIFI_RETRY_DELAY) {
-            debugLog("Attempting WiFi reconnection...");
-            WiFi.setSleep(false); // Full power for reconnection
-            WiFi.disconnect(true);  // Disconnect with clearing settings
-            delay(1000);  // Give it time to disconnect properly
-            WiFi.mode(WIFI_STA);    // Ensure we're in station mode
-            WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-            last_wifi_reconnect = millis();
-            wifi_ping_success = false;  // Reset ping status on reconnect
-            consecutive_ping_failures = 0;  // Reset failure counter
-            
-            // Set a timeout for the reconnection
-            unsigned long reconnect_start = millis();
-            bool reconnected = false;
-            
-            while (millis() - reconnect_start < 5000) {
-                if (WiFi.status() == WL_CONNECTED) {
-                    reconnected = true;
-                    break;
-                }
-                esp_task_wdt_reset();
-                delay(500);
-            }
-            
-            if (reconnected) {
-                debugLog("WiFi reconnection successful");
-            } else {
-                debugLog("WiFi reconnection attempt failed");
-            }
-        }
-    }
-    
-    return !connection_lost;
-}
-
 // Function to establish and verify WiFi connection
 bool establishWiFiConnection() {
     debugLog("WiFi connection attempt started");
@@ -799,7 +909,7 @@ bool establishWiFiConnection() {
             int rssi = WiFi.RSSI();
             unsigned long connectionTime = millis() - startTime;
             debugLog("WiFi connected - IP: %s, RSSI: %d dBm, Time: %lu ms", 
-                    WiFi.localIP().toString().c_str(), 
+                    localIpString(), 
                     rssi,
                     connectionTime);
             return connectionSuccess;
@@ -917,6 +1027,18 @@ bool setupNTP() {
     return false; // Should never reach here due to the retry loop
 }
 
+// Bring back a radio the power policy left off. This is a planned reconnect, not a lost
+// connection, so there is no collector health probe: the export it was woken for shows
+// whether the collector is reachable. If association fails, the loop's lost-connection
+// path takes over.
+bool unparkRadio() {
+    debugLog("Export window approaching - bringing WiFi back");
+    radio_parked = false;
+    flushCoordinator.noteRadioWake();
+    sleepTracker.beginReconnect(SLEEP_RADIO_OFF, millis());
+    return establishWiFiConnection();
+}
+
 // Function to verify OpenTelemetry collector health
 bool verifyOtelHealth() {
     debugLog("Verifying OpenTelemetry collector health...");
@@ -963,17 +1085,11 @@ bool ensureConnectivity() {
     }
 }
 
-// Function to query all sensors and update readings
-void querySensors() {
-    unsigned long startTime = millis();
-    debugLog("Querying sensors for fresh readings");
-    last_sensor_query = millis();
-    
-    // Capture timestamp when sensor data is collected (in nanoseconds)
+// Timestamp for a sensor reading in nanoseconds, from the RTC when available
+uint64_t readSensorTimestampNanos(bool* using_rtc = nullptr) {
     time_t now;
     
     // Use RTC if available, otherwise fall back to ESP32 time
-    bool using_rtc = false;
     if (M5.Rtc.isEnabled()) {
         // Get time from RTC hardware which is more accurate
         auto dt = M5.Rtc.getDateTime();
@@ -989,81 +1105,296 @@ void querySensors() {
         timeinfo.tm_isdst = 0; // No DST
         
         now = mktime(&timeinfo);
-        using_rtc = true;
+        if (using_rtc) *using_rtc = true;
         debugLog("Using RTC hardware for timestamp");
     } else {
         // Fallback to ESP32 internal time
         debugLog("RTC hardware not detected, using ESP32 internal time");
         time(&now);
+        if (using_rtc) *using_rtc = false;
     }
     
-    sensor_reading_timestamp = (uint64_t)now * 1000000000ULL;
-    
-    // Track sensor readings success
-    bool pressure_success = false;
-    bool temphum_success = false;
+    return (uint64_t)now * 1000000000ULL;
+}
+
+// Finest change the exported readings can show. Values are sent with two decimals; when
+// adaptive sampling or dual prediction decide what is sent, the error targets are coarser still.
+SensorPrecision exportedSensorPrecision() {
+    SensorPrecision precision = {0.01f, 0.01f, 1.0f};  // C, %RH, Pa (0.01 hPa)
+    if (ADAPTIVE_SAMPLING_ENABLED || DUAL_PREDICTION_ENABLED) {
+        precision.temperature = TEMP_ERROR_TARGET;
+        precision.humidity = HUM_ERROR_TARGET;
+        precision.pressure = PRESSURE_ERROR_TARGET * 100; // hPa to Pa
+    }
+    return precision;
+}
+
+// Switch both sensors to the profile for the last power state read; a no-op if it is unchanged
+void updateSensorProfile(uint64_t spanId) {
+    SensorProfileId wanted = (SensorProfileId)SENSOR_PROFILE;
+    if (wanted == SENSOR_PROFILE_AUTO) {
+        bool on_battery = !g_is_charging && g_battery_level < 100;
+        wanted = selectSensorProfile(on_battery, g_battery_level, exportedSensorPrecision());
+    }
+    if (sensor_profile_applied && wanted == sensor_profile) {
+        return;
+    }
+    
+    const SensorProfile& profile = getSensorProfile(wanted);
+    qmp.setOversamplingP(profile.qmpOversamplingP);
+    qmp.setOversamplingT(profile.qmpOversamplingT);
+    qmp.setFilter(profile.qmpFilter);
+    qmp.setpPowermode(profile.qmpForced ? QMP6988_SLEEP_MODE : QMP6988_NORMAL_MODE);
+    sht3x.setHeater(profile.shtHeater);
+    sensor_profile = wanted;
+    sensor_profile_applied = true;
+    
+    debugLog("Sensor profile %s: %u ms, %u uJ per reading", profile.name,
+             (unsigned)sensorProfileConversionMs(profile), (unsigned)profile.energyMicroJoules);
+    if (spanId != 0) {
+        otel.addSpanEvent(spanId, "sensor_profile_changed", "profile", profile.name);
+    }
+}
+
+// Add the sleep histograms that gained samples since the last export. Counts are cumulative
+// from boot, so a histogram that does not fit or is not delivered simply goes out next time.
+void addSleepHistograms() {
+    uint64_t boot_offset = (uint64_t)millis() * 1000000ULL;
+    if (sleep_stats_start_nanos == 0) {
+        if (sensor_reading_timestamp < 1600000000ULL * 1000000000ULL) {
+            return;  // Wall clock not set yet
+        }
+        sleep_stats_start_nanos = sensor_reading_timestamp - boot_offset;
+    }
     
-    // Get pressure reading - measure time taken
+    for (uint8_t i = 0; i < SLEEP_WAKE_CAUSE_COUNT; i++) {
+        SleepWakeCause cause = (SleepWakeCause)i;
+        if (sleepTracker.isDurationChanged(cause)) {
+            otel.addHistogram("sleep.duration", "ms", sleepTracker.getDurationHistogram(cause), sleep_stats_start_nanos,
+                              sensor_reading_timestamp, "wake.cause", sleepWakeCauseName(cause));
+        }
+    }
+    for (uint8_t i = 0; i < SLEEP_RADIO_MODE_COUNT; i++) {
+        SleepRadioMode mode = (SleepRadioMode)i;
+        if (sleepTracker.isReconnectChanged(mode)) {
+            const Histogram& reconnects = sleepTracker.getReconnectHistogram(mode);
+            otel.addHistogram("wifi.reconnect_time", "ms", reconnects, sleep_stats_start_nanos,
+                              sensor_reading_timestamp, "sleep.radio_mode", sleepRadioModeName(mode));
+            debugLog("Reconnect after %s sleep: %lu samples, 95%% within %lu ms (WIFI_RECONNECT_TIME %d ms)",
+                     sleepRadioModeName(mode), (unsigned long)reconnects.count, (unsigned long)reconnects.quantileBound(0.95f),
+                     (int)WIFI_RECONNECT_TIME);
+        }
+    }
+}
+
+// Put the radio at the controller's level for the AP we are associated with. The driver goes
+// back to full power whenever WiFi restarts, so this runs before every export.
+void applyTxPower(uint64_t spanId) {
+    txPowerController.selectNetwork(WiFi.BSSID());
+    wifi_power_t level = (wifi_power_t)txPowerController.getPower();
+    if (WiFi.getTxPower() == level) {
+        return;
+    }
+    if (!WiFi.setTxPower(level)) {
+        debugLog("Failed to set WiFi transmit power to %.2f dBm", txPowerController.getPowerDbm());
+        return;
+    }
+    debugLog("WiFi transmit power %.2f dBm for %s", txPowerController.getPowerDbm(), WiFi.BSSIDstr().c_str());
+    if (spanId != 0) {
+        otel.addSpanEvent(spanId, "tx_power_changed", "dbm", txPowerController.getPowerDbm());
+    }
+}
+
+// Read the QMP6988 pressure sensor into `pressure` - measure time taken
+bool readPressureSensor() {
     unsigned long pressure_start = millis();
+    const SensorProfile& profile = getSensorProfile(sensor_profile);
+    if (profile.qmpForced) {
+        // Start one conversion and wait it out; the sensor goes back to sleep by itself
+        qmp.setpPowermode(QMP6988_FORCE_MODE);
+        delay(profile.qmpConversionMs);
+    }
     if (qmp.update()) {
         unsigned long pressure_time = millis() - pressure_start;
         pressure = qmp.pressure;
-        pressure_success = true;
         debugLog("Pressure reading: %.2f hPa (took %lu ms)", pressure / 100, pressure_time);
-    } else {
-        unsigned long pressure_time = millis() - pressure_start;
-        debugLog("Failed to read QMP6988 sensor (after %lu ms)", pressure_time);
-        pressure_success = false;
+        return true;
     }
+    
+    unsigned long pressure_time = millis() - pressure_start;
+    debugLog("Failed to read QMP6988 sensor (after %lu ms)", pressure_time);
+    return false;
+}
 
-    // Get temperature and humidity readings - measure time taken
+// Read the SHT3X sensor into `temp` and `hum` - measure time taken
+bool readTempHumSensor() {
     unsigned long temphum_start = millis();
-    if (sht3x.update()) {
+    if (sht3x.update(getSensorProfile(sensor_profile).shtRepeatability)) {
         unsigned long temphum_time = millis() - temphum_start;
         temp = sht3x.cTemp;
         hum = sht3x.humidity;
-        temphum_success = true;
         debugLog("Temperature: %.2f°C, Humidity: %.2f%% (took %lu ms)", temp, hum, temphum_time);
-    } else {
-        unsigned long temphum_time = millis() - temphum_start;
-        debugLog("Failed to read SHT3X sensor (after %lu ms)", temphum_time);
-        temp = 0;
-        hum = 0;
-        temphum_success = false;
+        return true;
     }
+    
+    unsigned long temphum_time = millis() - temphum_start;
+    debugLog("Failed to read SHT3X sensor (after %lu ms)", temphum_time);
+    temp = 0;
+    hum = 0;
+    return false;
+}
 
-    // Gather battery and power information
+// Gather battery and power information into the g_ globals
+void readPowerState() {
     unsigned long battery_start = millis();
     auto power = M5.Power;
-    int battery_level = power.getBatteryLevel();
-    float battery_voltage = power.getBatteryVoltage();
-    bool is_charging = power.isCharging();
+    g_battery_level = power.getBatteryLevel();
+    g_battery_voltage = power.getBatteryVoltage();
+    g_is_charging = power.isCharging();
     unsigned long battery_time = millis() - battery_start;
     
-    // Store these as global variables for metrics and display
-    g_battery_level = battery_level;
-    g_battery_voltage = battery_voltage;
-    g_is_charging = is_charging;
-    
     debugLog("Battery: %d%%, %.2fV, Charging: %s (took %lu ms)", 
-             battery_level, 
-             battery_voltage/1000.0, // convert to volts for display
-             is_charging ? "Yes" : "No",
+             g_battery_level, 
+             g_battery_voltage/1000.0f, // convert to volts for display
+             g_is_charging ? "Yes" : "No",
              battery_time);
+}
+
+// Function to query all sensors and update readings; results are recorded on spanId (0 = none)
+void querySensors(uint64_t spanId) {
+    CpuPhaseScope cpuPhase(cpuGovernor, CPU_PHASE_SENSING);
+    unsigned long startTime = millis();
+    debugLog("Querying sensors for fresh readings");
+    last_sensor_query = millis();
+    
+    // Capture timestamp when sensor data is collected (in nanoseconds)
+    bool using_rtc = false;
+    sensor_reading_timestamp = readSensorTimestampNanos(&using_rtc);
+    
+    // Power state first - it picks the sensor profile for these readings
+    readPowerState();
+    updateSensorProfile(spanId);
+    
+    // Track sensor readings success
+    bool pressure_success = readPressureSensor();
+    bool temphum_success = readTempHumSensor();
     
     unsigned long total_time = millis() - startTime;
     debugLog("Total sensor query time: %lu ms", total_time);
     
-    // If tracing is enabled, these attributes will be added to the span by the caller
-    if (shouldEnableTracing()) {
-        // Add overall sensor status to the main span
-        otel.addSpanAttribute(sensor_reading_timestamp, "pressure_success", pressure_success ? "true" : "false");
-        otel.addSpanAttribute(sensor_reading_timestamp, "temphum_success", temphum_success ? "true" : "false");
-        otel.addSpanAttribute(sensor_reading_timestamp, "using_rtc", using_rtc ? "true" : "false");
-        otel.addSpanAttribute(sensor_reading_timestamp, "total_time_ms", (double)total_time);
-        otel.addSpanAttribute(sensor_reading_timestamp, "battery_level", (double)battery_level);
-        otel.addSpanAttribute(sensor_reading_timestamp, "is_charging", is_charging ? "true" : "false");
+    // Record the overall sensor status on the caller's span. The caller passes 0 when
+    // tracing is off, so no extra power-state reads are needed to decide this here.
+    if (spanId != 0) {
+        otel.addSpanAttribute(spanId, "pressure_success", pressure_success ? "true" : "false");
+        otel.addSpanAttribute(spanId, "temphum_success", temphum_success ? "true" : "false");
+        otel.addSpanAttribute(spanId, "using_rtc", using_rtc ? "true" : "false");
+        otel.addSpanAttribute(spanId, "total_time_ms", (float)total_time);
+        otel.addSpanAttribute(spanId, "is_charging", g_is_charging ? "true" : "false");
+        otel.addSpanAttribute(spanId, "sensor.profile", getSensorProfile(sensor_profile).name);
+    }
+}
+
+// Queue a sensor reading. With dual prediction the reading is only queued when it is
+// further from the shared model than the signal's error target; returns false if it was
+// needed but did not fit in the batch.
+bool addSensorMetric(const char* name, float value, DualPredictor& predictor, uint64_t spanId) {
+    if (DUAL_PREDICTION_ENABLED && !predictor.needsReport(value, sensor_reading_timestamp)) {
+        return true;
+    }
+    if (!otel.addMetric(name, value, sensor_reading_timestamp, spanId)) {
+        return false;
+    }
+    if (DUAL_PREDICTION_ENABLED) {
+        predictor.noteReported(value, sensor_reading_timestamp);
+    }
+    return true;
+}
+
+// Settle the readings reported since the last send: kept in the models if the collector
+// accepted the batch, forgotten if it was lost so the models match what the receiver has
+void settlePredictors(bool delivered) {
+    DualPredictor* predictors[] = {&tempPredictor, &humPredictor, &pressurePredictor};
+    for (DualPredictor* predictor : predictors) {
+        if (delivered) {
+            predictor->commit();
+        } else {
+            predictor->rollback();
+        }
+    }
+}
+
+// While WiFi is down the send path is never reached. Keep one set of readings per send
+// interval in the retention store so the outage still shows up once the device is back.
+void recordOfflineReadings() {
+#if OTEL_RETENTION_ENABLED
+    if (millis() - last_offline_reading < OTEL_SEND_INTERVAL) {
+        return;
+    }
+    last_offline_reading = millis();
+    
+    querySensors(0);
+    metricRetention.retain("temperature", temp, sensor_reading_timestamp);
+    metricRetention.retain("humidity", hum, sensor_reading_timestamp);
+    metricRetention.retain("pressure", pressure/100, sensor_reading_timestamp); // convert to hPa
+    metricRetention.retain("battery_level", g_battery_level, sensor_reading_timestamp);
+    metricRetention.retain("battery_voltage", g_battery_voltage/1000, sensor_reading_timestamp); // convert to volts
+    metricRetention.retain("battery_charging", g_is_charging ? 1 : 0, sensor_reading_timestamp);
+    debugLog("Recorded offline readings (%u entries retained, %lu hourly buckets lost)",
+             (unsigned)metricRetention.size(), (unsigned long)metricRetention.getDroppedBuckets());
+#endif
+}
+
+// Adaptive sampling: read only the sensors whose sampler is due and add each reading to the
+// metric batch with its own timestamp. Returns false if the batch has no room left, in
+// which case the readings wait until the batch has been sent.
+bool sampleSensorsIfDue(uint64_t spanId) {
+    uint32_t now = millis();
+    bool temphum_due = tempSampler.isDue(now) || humSampler.isDue(now);
+    bool pressure_due = pressureSampler.isDue(now);
+    if (!temphum_due && !pressure_due) {
+        return true;
+    }
+    
+    CpuPhaseScope cpuPhase(cpuGovernor, CPU_PHASE_SENSING);
+    
+    // Keep room for the metrics added at every send
+    if (otel.getMetricCount() + 3 + SAMPLE_RESERVED_METRICS > MAX_METRICS) {
+        debugLog("Metric batch full - sensor samples wait for the next send");
+        return false;
     }
+    
+    last_sensor_query = now;
+    sensor_reading_timestamp = readSensorTimestampNanos();
+    updateSensorProfile(spanId);
+    bool added = true;
+    
+    if (temphum_due && readTempHumSensor()) {
+        added &= addSensorMetric("temperature", temp, tempPredictor, spanId);
+        added &= addSensorMetric("humidity", hum, humPredictor, spanId);
+        tempSampler.update(temp, now);
+        humSampler.update(hum, now);
+        debugLog("Next temperature/humidity sample in %lu / %lu ms",
+                 (unsigned long)tempSampler.getInterval(), (unsigned long)humSampler.getInterval());
+    }
+    
+    if (pressure_due && readPressureSensor()) {
+        added &= addSensorMetric("pressure", pressure/100, pressurePredictor, spanId); // convert to hPa
+        pressureSampler.update(pressure/100, now);
+        debugLog("Next pressure sample in %lu ms", (unsigned long)pressureSampler.getInterval());
+    }
+    
+    if (spanId != 0) {
+        otel.addSpanAttribute(spanId, "temphum_sampled", temphum_due ? "true" : "false");
+        otel.addSpanAttribute(spanId, "pressure_sampled", pressure_due ? "true" : "false");
+    }
+    return added;
+}
+
+// Milliseconds until the next adaptive sensor sample is due
+unsigned long timeUntilNextSample() {
+    uint32_t now = millis();
+    return min(min(tempSampler.timeUntilDue(now), humSampler.timeUntilDue(now)),
+               pressureSampler.timeUntilDue(now));
 }
 
 // Function to send OpenTelemetry metrics
@@ -1082,10 +1413,8 @@ bool sendOtelMetrics() {
     
     if (WiFi.isConnected()) {
         otel.addMetric("network.rssi", WiFi.RSSI(), current_time_nanos);
-        if (spanId != 0) {
-            otel.addSpanAttribute(spanId, "wifi.connected", "true");
-            otel.addSpanAttribute(spanId, "wifi.rssi", (double)WiFi.RSSI());
-        }
+        otel.addSpanAttribute(spanId, "wifi.connected", "true");
+        otel.addSpanAttributeLazy(spanId, "wifi.rssi", []() { return (float)WiFi.RSSI(); });
     } else {
         // Don't even try to send if we're not connected
         debugLog("Cannot send metrics, WiFi not connected");
@@ -1227,6 +1556,31 @@ void setup() {
     // Set our custom time provider that uses the RTC
     otel.setTimeProvider(getDeviceTimeNanos);
     
+    // Initialize OpenTelemetry before the setup trace starts, since begin() clears the span queue
+    debugLog("Initializing OpenTelemetry client");
+    otel.begin(OTEL_SERVICE_NAME, OTEL_SERVICE_VERSION, OTEL_METRICS_URL, OTEL_TRACES_URL);
+    
+    // Explicitly set the endpoints to ensure they're properly initialized
+    otel.initializeMetricsEndpoint(OTEL_METRICS_URL);
+    otel.initializeTracesEndpoint(OTEL_TRACES_URL);
+    
+    // Optionally record every request on the serial port so it can be replayed from a host
+    if (OTEL_CAPTURE_ENABLED) {
+        otel.setCaptureStream(&Serial);
+    }
+    
+    // Keep failed metric batches for backfill instead of dropping them
+#if OTEL_RETENTION_ENABLED
+    otel.setRetention(&metricRetention, OTEL_SEND_INTERVAL);
+#endif
+    
+    // Mirror everything to a second collector if one is configured
+#if OTEL_MIRROR_ENABLED
+    if (exportFanout.addDestination(OTEL_MIRROR_METRICS_URL, OTEL_MIRROR_TRACES_URL)) {
+        otel.setFanout(&exportFanout);
+    }
+#endif
+    
     // Start a trace for the entire setup process - only if tracing is enabled
     try {
         otel.startNewTrace();
@@ -1236,15 +1590,7 @@ void setup() {
         debugLog("Error starting device setup trace - continuing without tracing");
     }
     
-    // Set up the display - create a child span
-    uint64_t displaySpanId = 0;
-    try {
-        displaySpanId = otel.startSpan("display_initialization", setupSpanId);
-        debugLog("Starting display initialization span: %016llx", displaySpanId);
-    } catch (...) {
-        debugLog("Error starting display span - continuing without span");
-    }
-    
+    // Set up the display
     M5.Display.setRotation(3);  // Landscape mode
     M5.Display.fillScreen(BLACK);
     M5.Display.setTextSize(2);  // Changed from 1 to 2 for larger text
@@ -1257,87 +1603,47 @@ void setup() {
     configurePowerManagement();
     last_button_press = millis();
     
-    // End display span safely
-    if (displaySpanId != 0) {
-        try {
-            otel.endSpan(displaySpanId);
-            debugLog("Display initialization span completed");
-        } catch (...) {
-            debugLog("Error ending display span - continuing");
-        }
-    }
+    // Small setup steps are recorded as events on the setup span rather than child spans
+    otel.addSpanEvent(setupSpanId, "display_initialized");
 
-    // Initialize the sensor units - create a child span
-    uint64_t sensorInitSpanId = 0;
-    try {
-        sensorInitSpanId = otel.startSpan("sensor_initialization", setupSpanId);
-        debugLog("Starting sensor initialization span: %016llx", sensorInitSpanId);
-    } catch (...) {
-        debugLog("Error starting sensor initialization span - continuing without span");
-    }
-    
+    // Initialize the sensor units
     debugLog("Initializing sensors");
     Wire.begin(32, 33); // SDA, SCL pins for M5StickC-Plus
     
     // Try to initialize the QMP6988 pressure sensor
-    if (qmp.begin(&Wire, QMP6988_SLAVE_ADDRESS_L, 32, 33, 400000U)) {
+    bool qmp_ok = qmp.begin(&Wire, QMP6988_SLAVE_ADDRESS_L, 32, 33, 400000U);
+    if (qmp_ok) {
         debugLog("QMP6988 pressure sensor initialized");
-        try {
-            if (sensorInitSpanId != 0) otel.addSpanAttribute(sensorInitSpanId, "qmp6988_init", "success");
-        } catch (...) { /* Ignore attribute errors */ }
     } else {
         debugLog("Failed to initialize QMP6988 pressure sensor");
-        try {
-            if (sensorInitSpanId != 0) otel.addSpanAttribute(sensorInitSpanId, "qmp6988_init", "failed");
-        } catch (...) { /* Ignore attribute errors */ }
     }
     
     // Try to initialize the SHT30 temperature/humidity sensor
-    if (sht3x.begin(&Wire, SHT3X_I2C_ADDR, 32, 33, 400000U)) {
+    bool sht_ok = sht3x.begin(&Wire, SHT3X_I2C_ADDR);
+    if (sht_ok) {
         debugLog("SHT3X temperature/humidity sensor initialized");
-        try {
-            if (sensorInitSpanId != 0) otel.addSpanAttribute(sensorInitSpanId, "sht3x_init", "success");
-        } catch (...) { /* Ignore attribute errors */ }
     } else {
         debugLog("Failed to initialize SHT3X temperature/humidity sensor");
-        try {
-            if (sensorInitSpanId != 0) otel.addSpanAttribute(sensorInitSpanId, "sht3x_init", "failed");
-        } catch (...) { /* Ignore attribute errors */ }
     }
     
-    if (sensorInitSpanId != 0) {
-        try {
-            otel.endSpan(sensorInitSpanId);
-            debugLog("Sensor initialization span completed");
-        } catch (...) {
-            debugLog("Error ending sensor initialization span - continuing");
-        }
-    }
+    otel.addSpanEvent(setupSpanId, "sensors_initialized", "status",
+                      qmp_ok && sht_ok ? "success" : 
+                      qmp_ok ? "sht3x_failed" : 
+                      sht_ok ? "qmp6988_failed" : "failed");
     
-    // Set up the watchdog timer - create a child span
-    uint64_t watchdogSpanId = 0;
-    try {
-        watchdogSpanId = otel.startSpan("watchdog_setup", setupSpanId);
-        debugLog("Starting watchdog setup span: %016llx", watchdogSpanId);
-    } catch (...) {
-        debugLog("Error starting watchdog setup span - continuing without span");
-    }
+    // Pick the measurement profile for the power state we start in
+    readPowerState();
+    updateSensorProfile(setupSpanId);
     
+    // Set up the watchdog timer
     debugLog("Configuring watchdog timer with %d second timeout", WDT_TIMEOUT);
     esp_task_wdt_init(WDT_TIMEOUT, true); // Initialize with timeout and panic mode
     esp_task_wdt_add(NULL);  // Add current thread to watchdog
     esp_task_wdt_reset();    // Reset timer
     
-    if (watchdogSpanId != 0) {
-        try {
-            otel.endSpan(watchdogSpanId);
-            debugLog("Watchdog setup span completed");
-        } catch (...) {
-            debugLog("Error ending watchdog setup span - continuing");
-        }
-    }
+    otel.addSpanEvent(setupSpanId, "watchdog_configured", "timeout_s", (float)WDT_TIMEOUT);
     
-    // Connect to WiFi - create a child span
+    // Connect to WiFi - a real network operation, so it keeps its own child span
     uint64_t wifiSpanId = 0;
     try {
         wifiSpanId = otel.startSpan("wifi_connection", setupSpanId);
@@ -1353,8 +1659,8 @@ void setup() {
         try {
             otel.addSpanAttribute(wifiSpanId, "success", connected ? "true" : "false");
             if (connected) {
-                otel.addSpanAttribute(wifiSpanId, "ip_address", WiFi.localIP().toString().c_str());
-                otel.addSpanAttribute(wifiSpanId, "rssi", (double)WiFi.RSSI());
+                otel.addSpanAttributeLazy(wifiSpanId, "ip_address", localIpString);
+                otel.addSpanAttributeLazy(wifiSpanId, "rssi", []() { return (float)WiFi.RSSI(); });
             } else {
                 otel.addSpanAttribute(wifiSpanId, "error", "connection_failed");
             }
@@ -1374,17 +1680,13 @@ void setup() {
     
     if (!connected) {
         debugLog("Failed to establish WiFi connection.");
-        try {
-            uint64_t setupSpan = otel.startSpan("device_setup", setupSpanId);
-            if (setupSpan != 0) {
-                otel.addSpanAttribute(setupSpan, "error", "wifi_connection_failed");
-            }
-        } catch (...) {
-            debugLog("Error adding WiFi error attribute to setup span - continuing");
-        }
+        otel.addSpanAttribute(setupSpanId, "error", "wifi_connection_failed");
         
         if (WIFI_REBOOT_ON_FAIL) {
             debugLog("WIFI_REBOOT_ON_FAIL is enabled. Rebooting...");
+            // End the setup span so it goes out with the flush
+            otel.addSpanEvent(setupSpanId, "rebooting");
+            otel.endSpan(setupSpanId);
             // Safely use the safer method for trace flushing
             bool success = otel.safeFlushTraces();
             if (success) {
@@ -1399,88 +1701,29 @@ void setup() {
         }
     }
     
-    // Sync time with NTP server - create a child span
-    uint64_t ntpSpanId = 0;
-    try {
-        ntpSpanId = otel.startSpan("ntp_sync", setupSpanId);
-        debugLog("Starting NTP sync span: %016llx", ntpSpanId);
-    } catch (...) {
-        debugLog("Error starting NTP sync span - continuing without span");
-    }
-    
+    // Sync time with NTP server
+    unsigned long ntp_start = millis();
     bool ntpSuccess = setupNTP();
     
-    // Add NTP results to span
-    if (ntpSpanId != 0) {
-        try {
-            otel.addSpanAttribute(ntpSpanId, "success", ntpSuccess ? "true" : "false");
-            if (!ntpSuccess) {
-                otel.addSpanAttribute(ntpSpanId, "error", "ntp_sync_failed");
-                
-                // Try to add error to main setup span
-                try {
-                    uint64_t setupSpan = otel.startSpan("device_setup", setupSpanId);
-                    if (setupSpan != 0) {
-                        otel.addSpanAttribute(setupSpan, "error", "ntp_sync_failed");
-                    }
-                } catch (...) {
-                    debugLog("Error adding NTP error attribute to setup span - continuing");
-                }
-            }
-        } catch (...) {
-            debugLog("Error adding NTP span attributes - continuing");
-        }
-    }
-    
-    if (ntpSpanId != 0) {
-        try {
-            otel.endSpan(ntpSpanId);
-            debugLog("NTP sync span completed");
-        } catch (...) {
-            debugLog("Error ending NTP sync span - continuing");
-        }
-    }
-    
-    // Get initial sensor readings - create a child span
-    uint64_t sensorDataSpanId = 0;
-    try {
-        sensorDataSpanId = otel.startSpan("initial_sensor_reading", setupSpanId);
-        debugLog("Starting initial sensor reading span: %016llx", sensorDataSpanId);
-    } catch (...) {
-        debugLog("Error starting initial sensor reading span - continuing without span");
+    if (ntpSuccess) {
+        otel.addSpanEvent(setupSpanId, "ntp_synced", "duration_ms", (float)(millis() - ntp_start));
+    } else {
+        otel.addSpanEvent(setupSpanId, "ntp_sync_failed", "duration_ms", (float)(millis() - ntp_start));
+        otel.addSpanAttribute(setupSpanId, "error", "ntp_sync_failed");
     }
     
+    // Get initial sensor readings
     debugLog("Getting initial sensor readings");
-    querySensors();
+    querySensors(setupSpanId);
     
-    // Add sensor reading results to span
-    if (sensorDataSpanId != 0) {
-        try {
-            otel.addSpanAttribute(sensorDataSpanId, "temperature", temp);
-            otel.addSpanAttribute(sensorDataSpanId, "humidity", hum);
-            otel.addSpanAttribute(sensorDataSpanId, "pressure", pressure/100);
-            otel.addSpanAttribute(sensorDataSpanId, "battery_level", (double)g_battery_level);
-        } catch (...) {
-            debugLog("Error adding sensor data span attributes - continuing");
-        }
-    }
+    // The first readings go on the setup span itself
+    otel.addSpanEvent(setupSpanId, "initial_sensor_reading");
+    otel.addSpanAttribute(setupSpanId, "temperature", temp);
+    otel.addSpanAttribute(setupSpanId, "humidity", hum);
+    otel.addSpanAttribute(setupSpanId, "pressure", pressure/100);
+    otel.addSpanAttribute(setupSpanId, "battery_level", (float)g_battery_level);
     
-    if (sensorDataSpanId != 0) {
-        try {
-            otel.endSpan(sensorDataSpanId);
-            debugLog("Initial sensor reading span completed");
-        } catch (...) {
-            debugLog("Error ending initial sensor reading span - continuing");
-        }
-    }
-    
-    // Initialize OpenTelemetry with the endpoint and service information
-    debugLog("Initializing OpenTelemetry client");
-    otel.begin(OTEL_SERVICE_NAME, OTEL_SERVICE_VERSION, OTEL_METRICS_URL, OTEL_TRACES_URL);
-    
-    // Explicitly set the endpoints to ensure they're properly initialized
-    otel.initializeMetricsEndpoint(OTEL_METRICS_URL);
-    otel.initializeTracesEndpoint(OTEL_TRACES_URL);
+    flushCoordinator.begin();
     
     if (otel.hasValidMetricsEndpoint() && otel.hasValidTracesEndpoint()) {
         debugLog("OpenTelemetry endpoints configured: Metrics=%s, Traces=%s", OTEL_METRICS_URL, OTEL_TRACES_URL);
@@ -1533,6 +1776,15 @@ void setup() {
     } catch (...) {
         debugLog("Error starting initial metrics collection trace - continuing without tracing");
     }
+    
+    // Setup ran at the default clock; from here on the loop's phases pick it
+    if (CPU_GOVERNOR_ENABLED) {
+        cpuGovernor.begin(getCpuFrequencyMhz());
+        debugLog("CPU governor active: %d MHz idle, %d MHz for exports", CPU_LOW_MHZ, CPU_BOOST_MHZ);
+    }
+#ifdef QEMU_TARGET
+    qemuReportStats("boot", 0);
+#endif
 }
 
 void loop() {
@@ -1547,29 +1799,44 @@ void loop() {
     M5.update();  // Read the press state of the buttons
     handleButtons();  // Handle any button events
     
+    // Serve a pending Prometheus scrape, if any (no work when nobody is scraping)
+    if (PROMETHEUS_ENABLED && WiFi.status() == WL_CONNECTED) {
+        promServer.begin();
+        promServer.handleClient();
+    }
+    
     // Handle display timeout to save power, but only after first metrics are sent
     if (display_on && (millis() - last_button_press > DISPLAY_TIMEOUT) && last_otel_send > 0) {
         turnOffDisplay();
     }
     
-    // Check if tracing is enabled and we need to flush traces (even if no metrics are ready)
+    // The metric send is the planned radio wake; pending spans are due by then at the latest
+    flushCoordinator.planNextWake(last_otel_send + OTEL_SEND_INTERVAL);
+    
+    // Bring a parked radio back in time for the export window (or when the user is looking)
+    if (radio_parked && (display_on || flushCoordinator.isRadioNeeded(WIFI_RECONNECT_TIME))) {
+        unparkRadio();
+    }
+    
+    // Traces normally ride along with the metric send; flush on their own only if the
+    // buffer is full, or if the radio is already fully awake anyway
     bool tracing_enabled = shouldEnableTracing();
-    if (tracing_enabled && WiFi.status() == WL_CONNECTED && (millis() - last_trace_flush >= TRACE_FLUSH_INTERVAL)) {
-        // Only attempt to flush if there are completed spans to send
-        uint8_t total, active, completed;
-        otel.getSpanStats(total, active, completed);
-        
-        if (completed > 0) {
-            debugLog("Regular trace flush triggered (%d completed spans)", completed);
-            bool success = otel.safeFlushTraces();
-            if (success) {
-                debugLog("Trace flush successful");
-            } else {
-                debugLog("Trace flush failed: %s", otel.getLastError());
-            }
+    bool trace_retry_due = !last_trace_flush_failed || (millis() - last_trace_flush >= TRACE_FLUSH_INTERVAL);
+    if (tracing_enabled && WiFi.status() == WL_CONNECTED && trace_retry_due &&
+        flushCoordinator.shouldFlushTracesNow(!WiFi.getSleep())) {
+        debugLog("Trace flush triggered (%lu bytes pending, oldest span %lu ms)",
+                 (unsigned long)otel.getPendingTraceBytes(), otel.getOldestPendingSpanAge());
+        CpuPhaseScope cpuPhase(cpuGovernor, CPU_PHASE_EXPORT);
+        bool success = otel.safeFlushTraces();
+        flushCoordinator.noteExport(success);
+        if (success) {
+            debugLog("Trace flush successful");
+        } else {
+            debugLog("Trace flush failed: %s", otel.getLastError());
         }
         
         last_trace_flush = millis();
+        last_trace_flush_failed = !success;
     }
     
     // Periodically log span statistics for debugging
@@ -1586,8 +1853,8 @@ void loop() {
         last_span_debug = millis();
     }
     
-    // Check WiFi status - no more tracing inside this function
-    if (WiFi.status() != WL_CONNECTED) {
+    // Check WiFi status - no more tracing inside this function (a parked radio is off on purpose)
+    if (WiFi.status() != WL_CONNECTED && !radio_parked) {
         debugLog("WiFi connection lost, restarting connection process");
         
         bool connected = false;
@@ -1638,21 +1905,33 @@ void loop() {
             } else {
                 debugLog("WIFI_REBOOT_ON_FAIL is disabled. Continuing without WiFi connection.");
                 // Will continue the loop but with limited functionality
+                recordOfflineReadings();
             }
         }
         
         return;  // Start fresh loop iteration
     }
     
+    // A reconnect after sleep that finished outside enterLightSleep(), e.g. for a parked radio
+    if (sleepTracker.isReconnecting() && WiFi.status() == WL_CONNECTED) {
+        debugLog("Connectivity back %lu ms after the radio was restored", (unsigned long)sleepTracker.noteConnected(millis()));
+    }
+    
+    // Between sends, take whichever sensor readings are due; they queue in the metric batch
+    if (ADAPTIVE_SAMPLING_ENABLED && millis() - last_otel_send < OTEL_SEND_INTERVAL && !sample_batch_full) {
+        if (!sampleSensorsIfDue(0)) {
+            debugLog("Sampled readings filled the metric batch - sending early");
+            sample_batch_full = true;
+        }
+    }
+    
     // Calculate time until next metric send
     unsigned long time_to_next_send = 0;
-    if (millis() > last_otel_send) {
+    if (millis() > last_otel_send && !sample_batch_full) {
         time_to_next_send = (last_otel_send + OTEL_SEND_INTERVAL - millis());
     }
     
     // Sleep strategy based on metric intervals
-    const unsigned long WIFI_RECONNECT_TIME = 30000; // 30 seconds for reconnect+stabilize+verify
-    
     // Check if power saving is enabled based on battery state
     bool enable_power_saving = shouldEnablePowerSaving();
     
@@ -1686,6 +1965,16 @@ void loop() {
             }
         }
         
+        // Wake for the next sensor sample; a reading alone does not need the radio
+        if (ADAPTIVE_SAMPLING_ENABLED) {
+            sleep_time = min((unsigned long)sleep_time, timeUntilNextSample());
+        }
+        
+        // Wake often enough to answer a waiting scrape
+        if (PROMETHEUS_ENABLED) {
+            sleep_time = min((unsigned long)sleep_time, (unsigned long)PROMETHEUS_MAX_SLEEP);
+        }
+        
         // Enter light sleep
         if (sleep_time > 500) { // Only sleep if we have at least 500ms to save
             debugLog("Starting light sleep for %llu ms (time to next metrics: %llu ms)", 
@@ -1700,10 +1989,13 @@ void loop() {
     esp_task_wdt_reset();
     
     // Only send metrics if enough time has passed since last send
-    if (millis() - last_otel_send >= OTEL_SEND_INTERVAL) {
+    if (millis() - last_otel_send >= OTEL_SEND_INTERVAL || sample_batch_full) {
         debugLog("Time to send metrics to OpenTelemetry (interval: %lu ms, last send: %lu ms ago)...", 
                 OTEL_SEND_INTERVAL, millis() - last_otel_send);
         
+        // Everything due this cycle drains inside this one radio window
+        flushCoordinator.openWindow();
+        
         // Create a span for sensor reading
         uint64_t sensorSpanId = 0;
         if (tracing_enabled) {
@@ -1715,8 +2007,16 @@ void loop() {
             }
         }
         
-        // Query sensors right before sending metrics
-        querySensors();
+        // Query sensors right before sending metrics. With adaptive sampling only the sensors
+        // that are due are read; the others already have their readings in the batch.
+        if (ADAPTIVE_SAMPLING_ENABLED) {
+            last_sensor_query = millis();
+            sensor_reading_timestamp = readSensorTimestampNanos();
+            readPowerState();
+            sampleSensorsIfDue(sensorSpanId);
+        } else {
+            querySensors(sensorSpanId);
+        }
         
         // End the sensor reading span
         if (sensorSpanId != 0) {
@@ -1724,7 +2024,7 @@ void loop() {
                 otel.addSpanAttribute(sensorSpanId, "temperature", temp);
                 otel.addSpanAttribute(sensorSpanId, "humidity", hum);
                 otel.addSpanAttribute(sensorSpanId, "pressure", pressure/100);
-                otel.addSpanAttribute(sensorSpanId, "battery_level", (double)g_battery_level);
+                otel.addSpanAttribute(sensorSpanId, "battery_level", (float)g_battery_level);
                 otel.endSpan(sensorSpanId);
                 debugLog("Completed sensor reading span");
             } catch (...) {
@@ -1735,6 +2035,7 @@ void loop() {
         // Ensure WiFi is fully awake before sending metrics
         if (WiFi.getSleep()) {
             debugLog("Waking up WiFi from sleep mode before sending metrics");
+            flushCoordinator.noteRadioWake();
             WiFi.setSleep(false);
             delay(100); // Brief delay to ensure modem is awake
         }
@@ -1762,6 +2063,7 @@ void loop() {
                 // Don't update last_otel_send here to allow retry on next loop
                 upload_fail_count++;
                 lastOtelError = "WiFi reconnection failed";
+                flushCoordinator.closeWindow();
                 return; // Skip this sending attempt
             }
         }
@@ -1771,18 +2073,37 @@ void loop() {
 
         // Add metrics to the batch with timestamp from when sensors were read
         bool all_metrics_added = true;
-        all_metrics_added &= otel.addMetric("temperature", temp, sensor_reading_timestamp);
-        all_metrics_added &= otel.addMetric("humidity", hum, sensor_reading_timestamp);
-        all_metrics_added &= otel.addMetric("pressure", pressure/100, sensor_reading_timestamp); // convert to hPa
-        all_metrics_added &= otel.addMetric("battery_level", g_battery_level, sensor_reading_timestamp);
-        all_metrics_added &= otel.addMetric("battery_voltage", g_battery_voltage/1000, sensor_reading_timestamp); // convert to volts
-        all_metrics_added &= otel.addMetric("battery_charging", g_is_charging ? 1 : 0, sensor_reading_timestamp);
+        // Sensor values carry the sensor_reading span as their exemplar
+        if (!ADAPTIVE_SAMPLING_ENABLED) {
+            all_metrics_added &= addSensorMetric("temperature", temp, tempPredictor, sensorSpanId);
+            all_metrics_added &= addSensorMetric("humidity", hum, humPredictor, sensorSpanId);
+            all_metrics_added &= addSensorMetric("pressure", pressure/100, pressurePredictor, sensorSpanId); // convert to hPa
+        }
+        all_metrics_added &= otel.addMetric("battery_level", g_battery_level, sensor_reading_timestamp, sensorSpanId);
+        all_metrics_added &= otel.addMetric("battery_voltage", g_battery_voltage/1000, sensor_reading_timestamp, sensorSpanId); // convert to volts
+        all_metrics_added &= otel.addMetric("battery_charging", g_is_charging ? 1 : 0, sensor_reading_timestamp, sensorSpanId);
         all_metrics_added &= otel.addMetric("wifi.rssi", WiFi.RSSI(), sensor_reading_timestamp);
         all_metrics_added &= otel.addMetric("FreeHeap", ESP.getFreeHeap(), sensor_reading_timestamp); // added for testing
+        all_metrics_added &= otel.addMetric("radio.wakes_per_hour", flushCoordinator.getRadioWakesPerHour(), sensor_reading_timestamp);
+        if (TX_POWER_CONTROL_ENABLED) {
+            all_metrics_added &= otel.addMetric("wifi.tx_power", txPowerController.getPowerDbm(), sensor_reading_timestamp);
+        }
+        if (SLEEP_STATS_ENABLED) {
+            all_metrics_added &= otel.addMetric("sleep.duty_cycle", sleepTracker.getDutyCycle(millis()), sensor_reading_timestamp);
+            all_metrics_added &= otel.addMetric("sleep.planned_share", sleepTracker.getPlannedShare(), sensor_reading_timestamp);
+            addSleepHistograms();
+        }
 
         if (!all_metrics_added) {
             debugLog("Warning: Some metrics weren't added due to buffer constraints");
         }
+        if (DUAL_PREDICTION_ENABLED) {
+            debugLog("Dual prediction: %lu readings sent, %lu within the model",
+                     (unsigned long)(tempPredictor.getReportedCount() + humPredictor.getReportedCount() +
+                                     pressurePredictor.getReportedCount()),
+                     (unsigned long)(tempPredictor.getSuppressedCount() + humPredictor.getSuppressedCount() +
+                                     pressurePredictor.getSuppressedCount()));
+        }
 
         // Create a span for metrics sending if tracing is enabled
         uint64_t metricsSpanId = 0;
@@ -1791,10 +2112,13 @@ void loop() {
                 metricsSpanId = otel.startSpan("metric_send");
                 debugLog("Started metric send span: %016llx", metricsSpanId);
                 
-                // Add context to span
-                otel.addSpanAttribute(metricsSpanId, "wifi.rssi", (double)WiFi.RSSI());
-                otel.addSpanAttribute(metricsSpanId, "metrics_count", 7.0); // Number of metrics we're sending
+                // Add context to span - the RSSI is only read if the span is actually recorded
+                otel.addSpanAttributeLazy(metricsSpanId, "wifi.rssi", []() { return (float)WiFi.RSSI(); });
+                otel.addSpanAttribute(metricsSpanId, "metrics_count", (float)otel.getMetricCount()); // Number of metrics we're sending
                 otel.addSpanAttribute(metricsSpanId, "all_metrics_added", all_metrics_added ? "true" : "false");
+                if (TX_POWER_CONTROL_ENABLED) {
+                    otel.addSpanAttribute(metricsSpanId, "wifi.tx_power", txPowerController.getPowerDbm());
+                }
                 
                 if (!all_metrics_added) {
                     otel.addSpanAttribute(metricsSpanId, "error", "buffer_constraints");
@@ -1804,17 +2128,90 @@ void loop() {
             }
         }
 
-        // Send both metrics and traces
+        if (TX_POWER_CONTROL_ENABLED) {
+            applyTxPower(metricsSpanId);
+        }
+
+        // Encoding and sending run at the boost clock
+#ifdef QEMU_TARGET
+        uint32_t send_start_cycles = ESP.getCycleCount();
+#endif
+        CpuPhase previousPhase = cpuGovernor.enter(CPU_PHASE_EXPORT);
+        
+        // Send both metrics and traces back to back over the same connection
+        unsigned long send_start = millis();
+        uint32_t batches_before = otel.getSentMetricBatchCount();
         bool success = otel.safeSendMetricsAndTraces();
+        if (DUAL_PREDICTION_ENABLED) {
+            settlePredictors(otel.getSentMetricBatchCount() != batches_before);
+        }
+        flushCoordinator.noteExport(success);
+        if (SLEEP_STATS_ENABLED) {
+            if (success) {
+                sleepTracker.markExported();
+            }
+            sleepTracker.resetWindow(millis());
+        }
+        
+        // Any HTTP status means the radio got the request through, even if the collector refused it.
+        // Retransmissions are not visible from here, so a slow upload stands in for them.
+        if (TX_POWER_CONTROL_ENABLED &&
+            txPowerController.noteUpload(success || otel.getLastHttpCode() > 0, millis() - send_start, WiFi.RSSI())) {
+            applyTxPower(metricsSpanId);
+        }
+        sample_batch_full = false;
+        
+        // Backfill what piled up during an outage while the radio is still up
+        if (success && otel.hasRetainedMetrics()) {
+            esp_task_wdt_reset();
+            otel.sendRetainedMetrics(OTEL_RETENTION_BACKFILL_REQUESTS);
+        }
+        
+        // Retry requests spooled for extra collectors whose backoff has run out
+#if OTEL_MIRROR_ENABLED
+        if (exportFanout.hasSpooledRequests()) {
+            esp_task_wdt_reset();
+            exportFanout.service();
+            exportFanout.logStats();
+        }
+#endif
+        cpuGovernor.enter(previousPhase);
+#ifdef QEMU_TARGET
+        qemuReportStats(success ? "send" : "send_failed", ESP.getCycleCount() - send_start_cycles);
+#endif
+        
+        // A successful export already proved the collector healthy; only check explicitly
+        // if it failed, while the radio is still awake
+        if (flushCoordinator.isHealthCheckDue(true)) {
+            wifi_ping_success = pingTest();
+            last_wifi_ping = millis();
+        }
+        flushCoordinator.closeWindow();
+        flushCoordinator.logStats();
+        debugLog("Collector response %lu ms (+/- %lu), next deadline %lu ms, %lu requests timed out",
+                 (unsigned long)otel.getMetricsRtt().getSmoothedRtt(),
+                 (unsigned long)otel.getMetricsRtt().getRttVariation(),
+                 (unsigned long)otel.getMetricsRtt().getTimeout(), (unsigned long)otel.getTimeoutCount());
         
         // Add result to span and end it
         if (metricsSpanId != 0) {
             try {
                 otel.addSpanAttribute(metricsSpanId, "success", success ? "true" : "false");
                 
+                if (CPU_GOVERNOR_ENABLED) {
+                    uint32_t boost_ms = cpuGovernor.getTimeAt(CPU_BOOST_MHZ);
+                    uint32_t low_ms = cpuGovernor.getTimeAt(CPU_LOW_MHZ);
+                    otel.addSpanAttribute(metricsSpanId, "cpu.boost_share", 
+                                          boost_ms + low_ms > 0 ? 100.0f * boost_ms / (boost_ms + low_ms) : 0.0f);
+                    debugLog("CPU time: %lu ms at %d MHz, %lu ms at %d MHz, %lu switches",
+                             (unsigned long)low_ms, CPU_LOW_MHZ, (unsigned long)boost_ms, CPU_BOOST_MHZ,
+                             (unsigned long)cpuGovernor.getSwitchCount());
+                }
+                
                 if (!success) {
-                    otel.addSpanAttribute(metricsSpanId, "error", otel.getLastError());
-                    otel.addSpanAttribute(metricsSpanId, "http_code", (double)otel.getLastHttpCode());
+                    otel.addSpanAttributeCopy(metricsSpanId, "error", otel.getLastError());
+                    otel.addSpanAttribute(metricsSpanId, "http_code", (float)otel.getLastHttpCode());
+                    otel.addSpanAttribute(metricsSpanId, "http.timeouts", (float)otel.getTimeoutCount());
                 }
                 
                 // End the span
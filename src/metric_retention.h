@@ -0,0 +1,196 @@
+#ifndef METRIC_RETENTION_H
+#define METRIC_RETENTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Readings kept at full resolution before they are rolled up
+#ifndef RETENTION_RAW_POINTS
+#define RETENTION_RAW_POINTS 60
+#endif
+// Fine tier: 5 minute buckets
+#ifndef RETENTION_FINE_BUCKETS
+#define RETENTION_FINE_BUCKETS 144
+#endif
+#ifndef RETENTION_FINE_SECONDS
+#define RETENTION_FINE_SECONDS 300
+#endif
+// Coarse tier: hourly buckets (432 = three days of the six readings kept offline)
+#ifndef RETENTION_COARSE_BUCKETS
+#define RETENTION_COARSE_BUCKETS 432
+#endif
+#ifndef RETENTION_COARSE_SECONDS
+#define RETENTION_COARSE_SECONDS 3600
+#endif
+
+// One reading at full resolution
+struct RetainedPoint {
+    const char* name;         // Metric names are string literals, as everywhere else
+    float value;
+    uint32_t seconds;         // Unix time
+};
+
+// min/max/sum/count of one metric over one window
+struct RetainedBucket {
+    const char* name;
+    uint32_t startSeconds;
+    float min;
+    float max;
+    float sum;
+    uint16_t count;
+};
+
+// Fixed-capacity FIFO; index 0 is the oldest entry
+template <typename T, size_t N>
+class RetentionRing {
+private:
+    T items[N];
+    size_t head;
+    size_t count;
+
+public:
+    RetentionRing() : head(0), count(0) {}
+
+    size_t size() const {
+        return count;
+    }
+
+    bool isFull() const {
+        return count == N;
+    }
+
+    T& at(size_t index) {
+        return items[(head + index) % N];
+    }
+
+    const T& at(size_t index) const {
+        return items[(head + index) % N];
+    }
+
+    // Caller makes room first
+    void push(const T& item) {
+        items[(head + count) % N] = item;
+        count++;
+    }
+
+    T popOldest() {
+        T item = items[head];
+        head = (head + 1) % N;
+        count--;
+        return item;
+    }
+
+    void dropOldest(size_t n) {
+        n = n < count ? n : count;
+        head = (head + n) % N;
+        count -= n;
+    }
+};
+
+// Where readings go when they cannot be sent. Memory is fixed up front: the newest readings
+// are kept as they are, and when that tier fills the oldest reading is folded into a 5 minute
+// bucket, then into an hourly one. Only when the hourly tier is full is anything lost, and
+// then it is the oldest hour. A long outage therefore always leaves its whole shape behind,
+// just at a coarser resolution the further back it goes.
+class MetricRetention {
+private:
+    RetentionRing<RetainedPoint, RETENTION_RAW_POINTS> raw;
+    RetentionRing<RetainedBucket, RETENTION_FINE_BUCKETS> fine;
+    RetentionRing<RetainedBucket, RETENTION_COARSE_BUCKETS> coarse;
+    uint32_t droppedBuckets;
+
+    // Fold into the newest bucket of the same metric and window, searching back from the newest
+    template <size_t N>
+    static bool mergeInto(RetentionRing<RetainedBucket, N>& tier, const RetainedBucket& item, uint32_t start) {
+        for (size_t i = tier.size(); i > 0; i--) {
+            RetainedBucket& bucket = tier.at(i - 1);
+            if (bucket.startSeconds == start && (bucket.name == item.name || strcmp(bucket.name, item.name) == 0)) {
+                bucket.min = item.min < bucket.min ? item.min : bucket.min;
+                bucket.max = item.max > bucket.max ? item.max : bucket.max;
+                bucket.sum += item.sum;
+                uint32_t count = (uint32_t)bucket.count + item.count;
+                bucket.count = count > 0xFFFF ? 0xFFFF : (uint16_t)count;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void rollIntoCoarse(RetainedBucket bucket) {
+        uint32_t start = bucket.startSeconds - bucket.startSeconds % RETENTION_COARSE_SECONDS;
+        if (mergeInto(coarse, bucket, start)) {
+            return;
+        }
+        if (coarse.isFull()) {
+            coarse.popOldest();
+            droppedBuckets++;
+        }
+        bucket.startSeconds = start;
+        coarse.push(bucket);
+    }
+
+    void rollIntoFine(const RetainedPoint& point) {
+        RetainedBucket bucket = {point.name, 0, point.value, point.value, point.value, 1};
+        uint32_t start = point.seconds - point.seconds % RETENTION_FINE_SECONDS;
+        if (mergeInto(fine, bucket, start)) {
+            return;
+        }
+        if (fine.isFull()) {
+            rollIntoCoarse(fine.popOldest());
+        }
+        bucket.startSeconds = start;
+        fine.push(bucket);
+    }
+
+public:
+    MetricRetention() : droppedBuckets(0) {}
+
+    void retain(const char* name, float value, uint64_t timestampNanos) {
+        if (raw.isFull()) {
+            rollIntoFine(raw.popOldest());
+        }
+        RetainedPoint point = {name, value, (uint32_t)(timestampNanos / 1000000000ULL)};
+        raw.push(point);
+    }
+
+    bool isEmpty() const {
+        return raw.size() == 0 && fine.size() == 0 && coarse.size() == 0;
+    }
+
+    size_t size() const {
+        return raw.size() + fine.size() + coarse.size();
+    }
+
+    // Tiers are exposed oldest first; drop...() removes entries once they have been sent
+    const RetentionRing<RetainedBucket, RETENTION_COARSE_BUCKETS>& getCoarse() const {
+        return coarse;
+    }
+
+    const RetentionRing<RetainedBucket, RETENTION_FINE_BUCKETS>& getFine() const {
+        return fine;
+    }
+
+    const RetentionRing<RetainedPoint, RETENTION_RAW_POINTS>& getRaw() const {
+        return raw;
+    }
+
+    void dropCoarse(size_t n) {
+        coarse.dropOldest(n);
+    }
+
+    void dropFine(size_t n) {
+        fine.dropOldest(n);
+    }
+
+    void dropRaw(size_t n) {
+        raw.dropOldest(n);
+    }
+
+    // Hourly buckets lost because the whole budget was in use
+    uint32_t getDroppedBuckets() const {
+        return droppedBuckets;
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef NUMERIC_VALUE_H
+#define NUMERIC_VALUE_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Enough room for any float printed with two decimals (-FLT_MAX has 39 integer digits).
+// Doubles beyond 1e40 are truncated.
+#define NUMERIC_VALUE_TEXT_SIZE 48
+
+// Telemetry number. Stored as float because the ESP32 FPU is single precision only;
+// double is an explicit opt-in (fromDouble) for values that need it.
+class NumericValue {
+private:
+    union {
+        float f;
+        double d;
+    } storage;
+    bool isDouble;
+
+public:
+    NumericValue() : isDouble(false) {
+        storage.f = 0;
+    }
+
+    NumericValue(float value) : isDouble(false) {
+        storage.f = value;
+    }
+
+    static NumericValue fromDouble(double value) {
+        NumericValue result;
+        result.storage.d = value;
+        result.isDouble = true;
+        return result;
+    }
+
+    bool isDoublePrecision() const {
+        return isDouble;
+    }
+
+    float toFloat() const {
+        return isDouble ? (float)storage.d : storage.f;
+    }
+
+    double toDouble() const {
+        return isDouble ? storage.d : storage.f;
+    }
+
+    // Write the value with two decimals; same text as printf("%.2f") of the stored value
+    int format(char* buffer, size_t size) const {
+        if (isDouble) {
+            return snprintf(buffer, size, "%.2f", storage.d);
+        }
+        return formatFixed2(buffer, size, storage.f);
+    }
+
+    // printf("%.2f") for a float using integer math only. The float is split into its
+    // 24-bit mantissa and exponent, so value * 100 is computed exactly and rounded
+    // half-to-even like printf. No double conversion or software dtoa is involved.
+    static int formatFixed2(char* buffer, size_t size, float value) {
+        float magnitude = fabsf(value);
+        if (!(magnitude < 21474836.0f)) {
+            return snprintf(buffer, size, "%.2f", (double)value); // NaN, inf and huge values
+        }
+
+        int exponent;
+        float fraction = frexpf(magnitude, &exponent); // magnitude = fraction * 2^exponent
+        int64_t mantissa = (int64_t)ldexpf(fraction, 24);
+        int64_t scaled = mantissa * 100;
+        int shift = 24 - exponent;
+
+        int64_t hundredths;
+        if (shift <= 0) {
+            hundredths = scaled << -shift;
+        } else if (shift >= 40) {
+            hundredths = 0; // Below 0.005 even before rounding
+        } else {
+            hundredths = scaled >> shift;
+            int64_t remainder = scaled - (hundredths << shift);
+            int64_t half = (int64_t)1 << (shift - 1);
+            if (remainder > half || (remainder == half && (hundredths & 1))) {
+                hundredths++;
+            }
+        }
+
+        return snprintf(buffer, size, "%s%ld.%02ld", signbit(value) ? "-" : "",
+                        (long)(hundredths / 100), (long)(hundredths % 100));
+    }
+};
+
+#endif
@@ -5,15 +5,65 @@
 #include <HTTPClient.h>
 #include "config.h"
 #include "debug.h"
+#include "fixed_string.h"
+#include "numeric_value.h"
+#include "metric_retention.h"
+#include "export_fanout.h"
+#include "rtt_estimator.h"
+#include "histogram.h"
 
-// Define a maximum number of metrics to prevent unbounded growth
-#define MAX_METRICS 15
+// Define a maximum number of metrics to prevent unbounded growth. The default holds a send
+// interval of adaptive samples at the default rates next to the metrics added at every send.
+#ifndef MAX_METRICS
+#define MAX_METRICS 24
+#endif
+// Histogram points one metrics request can carry, on top of MAX_METRICS
+#ifndef MAX_HISTOGRAMS
+#define MAX_HISTOGRAMS 4
+#endif
 // Define a maximum number of spans to prevent unbounded growth
 #define MAX_SPANS 50
-// Maximum number of spans to keep in memory at once for sending
-#define MAX_SPANS_PER_BATCH 15
+// Largest request body the transport sends in one go (also the size of the payload buffer)
+#ifndef OTEL_MAX_PAYLOAD_BYTES
+#define OTEL_MAX_PAYLOAD_BYTES 4096
+#endif
+// Flush traces once this many encoded bytes are pending - by default, one full request
+#ifndef OTEL_BATCH_FLUSH_BYTES
+#define OTEL_BATCH_FLUSH_BYTES OTEL_MAX_PAYLOAD_BYTES
+#endif
+// Flush traces once the oldest pending span has waited this long (ms)
+#ifndef OTEL_BATCH_MAX_AGE
+#ifdef TRACE_FLUSH_INTERVAL
+#define OTEL_BATCH_MAX_AGE TRACE_FLUSH_INTERVAL
+#else
+#define OTEL_BATCH_MAX_AGE 30000
+#endif
+#endif
 // Define a maximum number of span attributes
 #define MAX_SPAN_ATTRS 10
+// Events kept per span; when full, the oldest event is dropped and counted
+#ifndef MAX_SPAN_EVENTS
+#define MAX_SPAN_EVENTS 6
+#endif
+// Event slots shared by all spans; when every slot is taken, new events are dropped and counted
+#ifndef OTEL_SPAN_EVENT_POOL
+#define OTEL_SPAN_EVENT_POOL 16
+#endif
+// Bytes per span for copies of deferred string values, taken when the span ends (max 254)
+#ifndef SPAN_TEXT_POOL_SIZE
+#define SPAN_TEXT_POOL_SIZE 64
+#endif
+// Capacity of the last error message (longer collector responses are truncated)
+#define OTEL_ERROR_MESSAGE_SIZE 96
+// Longest metric name the Prometheus endpoint writes (longer names are truncated)
+#define OTEL_PROMETHEUS_NAME_SIZE 48
+// Prefix of capture records written by the request tee (must match tools/otlp_replay)
+#define OTEL_CAPTURE_MARKER "#OTLPCAP"
+
+// Deferred attribute values, called at most once when the span ends (captureless lambdas work).
+// A string provider's text is copied then, so it may point into a buffer that is reused later.
+typedef float (*NumericAttributeProvider)();
+typedef const char* (*StringAttributeProvider)();
 
 class OpenTelemetry {
 private:
@@ -46,21 +96,104 @@ private:
 
     struct MetricPoint {
         const char* name;
-        double value;
+        NumericValue value;
         uint64_t timestamp_nanos;
-        MetricPoint() : name(nullptr), value(0), timestamp_nanos(0) {}
-        MetricPoint(const char* n, double v, uint64_t ts) : name(n), value(v), timestamp_nanos(ts) {}
+        // Exemplar: the span that was active when the point was recorded (spanId 0 = none).
+        // One fixed slot per point, so exemplar memory never grows.
+        uint64_t exemplarTraceId[2];
+        uint64_t exemplarSpanId;
+        MetricPoint() : name(nullptr), value(0), timestamp_nanos(0), exemplarSpanId(0) {
+            exemplarTraceId[0] = 0;
+            exemplarTraceId[1] = 0;
+        }
+        MetricPoint(const char* n, NumericValue v, uint64_t ts) : name(n), value(v), timestamp_nanos(ts), exemplarSpanId(0) {
+            exemplarTraceId[0] = 0;
+            exemplarTraceId[1] = 0;
+        }
     };
     
+    // Marks a string attribute whose value is not held in the span's text pool
+    static const uint8_t SPAN_TEXT_NONE = 0xFF;
+    
     // Structure for span attributes
     struct SpanAttribute {
         const char* key;
-        const char* stringValue;
-        double doubleValue;
+        const char* stringValue;             // Kept as given; expected to outlive the span (a literal)
+        NumericValue numericValue;
+        bool isString;
+        bool isLazy;                         // Value still has to be fetched from the provider
+        uint8_t textOffset;                  // Copy of the string in the span's text pool
+        union {
+            NumericAttributeProvider numeric;
+            StringAttributeProvider text;
+        } provider;
+        SpanAttribute() : key(nullptr), stringValue(nullptr), isString(true), isLazy(false), textOffset(SPAN_TEXT_NONE) {}
+        SpanAttribute(const char* k, const char* v) : key(k), stringValue(v), isString(true), isLazy(false), textOffset(SPAN_TEXT_NONE) {}
+        SpanAttribute(const char* k, NumericValue v) : key(k), stringValue(nullptr), numericValue(v), isString(false), isLazy(false),
+                                                       textOffset(SPAN_TEXT_NONE) {}
+        SpanAttribute(const char* k, NumericAttributeProvider p) : key(k), stringValue(nullptr), isString(false), isLazy(true),
+                                                                   textOffset(SPAN_TEXT_NONE) {
+            provider.numeric = p;
+        }
+        SpanAttribute(const char* k, StringAttributeProvider p) : key(k), stringValue(nullptr), isString(true), isLazy(true),
+                                                                  textOffset(SPAN_TEXT_NONE) {
+            provider.text = p;
+        }
+        
+        // Fetch a deferred value; afterwards the attribute is a plain value. A string is copied
+        // into the span's text pool.
+        void resolve(char* pool, uint8_t& poolUsed) {
+            if (!isLazy) {
+                return;
+            }
+            isLazy = false;
+            if (!isString) {
+                numericValue = provider.numeric ? NumericValue(provider.numeric()) : NumericValue();
+                return;
+            }
+            copyText(provider.text ? provider.text() : nullptr, pool, poolUsed);
+        }
+        
+        // Copy a string value into `pool`, truncated to the room left, with quotes, backslashes
+        // and control characters replaced so it needs no escaping. The copy is found by offset,
+        // not by pointer, because spans are moved when the queue is compacted.
+        void copyText(const char* value, char* pool, uint8_t& poolUsed) {
+            if (!value || poolUsed >= SPAN_TEXT_POOL_SIZE) {
+                return;
+            }
+            char* copy = pool + poolUsed;
+            size_t room = SPAN_TEXT_POOL_SIZE - poolUsed - 1;
+            size_t length = 0;
+            for (; value[length] && length < room; length++) {
+                char c = value[length];
+                copy[length] = c == '"' || c == '\\' ? '\'' : (uint8_t)c < 0x20 ? ' ' : c;
+            }
+            copy[length] = '\0';
+            textOffset = poolUsed;
+            poolUsed += (uint8_t)(length + 1);
+        }
+        
+        // The string value, wherever it is held (`pool` is the owning span's text pool)
+        const char* text(const char* pool) const {
+            if (textOffset != SPAN_TEXT_NONE) {
+                return pool + textOffset;
+            }
+            return stringValue ? stringValue : "";
+        }
+    };
+    
+    // Timestamped annotation inside a span, with at most one literal or float attribute
+    // (key nullptr = none). Events live in a pool shared by all spans, since most spans have none.
+    struct SpanEvent {
+        uint64_t spanId;                     // Owning span, 0 for a free slot
+        const char* name;
+        const char* key;
+        const char* stringValue;             // Used when isString, otherwise numericValue
+        float numericValue;
+        uint64_t timeUnixNanos;              // Absolute, so a clock step (e.g. NTP) cannot clamp it
         bool isString;
-        SpanAttribute() : key(nullptr), stringValue(nullptr), doubleValue(0), isString(true) {}
-        SpanAttribute(const char* k, const char* v) : key(k), stringValue(v), doubleValue(0), isString(true) {}
-        SpanAttribute(const char* k, double v) : key(k), stringValue(nullptr), doubleValue(v), isString(false) {}
+        SpanEvent() : spanId(0), name(nullptr), key(nullptr), stringValue(nullptr), numericValue(0), timeUnixNanos(0),
+                      isString(true) {}
     };
     
     // Structure for spans
@@ -73,11 +206,19 @@ private:
         uint64_t endTimeNanos;               // End time in nanoseconds
         SpanAttribute attributes[MAX_SPAN_ATTRS]; // Span attributes
         uint8_t attributeCount;              // Number of attributes
+        char text[SPAN_TEXT_POOL_SIZE];      // Copies of deferred string values
+        uint8_t textUsed;                    // Bytes of the text pool in use
+        uint8_t eventCount;                  // Number of events held in the event pool
+        uint16_t droppedEventCount;          // Events overwritten or not stored for lack of room
         bool isActive;                       // Whether the span is currently active
+        bool inFlight;                       // Whether the span is part of the batch being sent
+        uint16_t encodedSize;                // Exact JSON size, measured when the span ends
+        uint32_t completedAtMillis;          // millis() when the span ended, for batch age
         
         Span() : spanId(0), parentSpanId(0), startTimeNanos(0), endTimeNanos(0), 
-                 attributeCount(0), isActive(false) {
+                 attributeCount(0), textUsed(0), eventCount(0), droppedEventCount(0), isActive(false), inFlight(false), encodedSize(0), completedAtMillis(0) {
             name[0] = '\0';
+            text[0] = '\0';
             traceId[0] = 0;
             traceId[1] = 0;
         }
@@ -88,31 +229,153 @@ private:
     const char* metricsEndpoint;
     const char* tracesEndpoint;
     HTTPClient http;
-    String lastErrorMessage;
+    FixedString<OTEL_ERROR_MESSAGE_SIZE> lastErrorMessage;
     int lastHttpCode;
     
     // Fixed-size array instead of vector to avoid dynamic memory allocation
     MetricPoint batchMetrics[MAX_METRICS];
     uint8_t metricCount;
     
+    // Histogram points for the next metrics request, copied so later samples do not change
+    // the size measured when they were added
+    struct HistogramPoint {
+        const char* name;
+        const char* unit;
+        const char* attributeKey;     // One optional string attribute (nullptr for none)
+        const char* attributeValue;
+        uint64_t startTimeNanos;
+        uint64_t timeNanos;
+        Histogram data;
+    };
+    HistogramPoint batchHistograms[MAX_HISTOGRAMS];
+    uint8_t histogramCount;
+    
+    // Latest value of every metric name seen so far - survives sends so it can be scraped
+    struct LatestMetric {
+        const char* name;
+        NumericValue value;
+        uint64_t timestamp_nanos;
+    };
+    LatestMetric latestMetrics[MAX_METRICS];
+    uint8_t latestMetricCount;
+    
+    // Remember the newest value for a metric name (names are expected to be string literals)
+    void updateLatestMetric(const char* name, NumericValue value, uint64_t timestamp_nanos) {
+        for (uint8_t i = 0; i < latestMetricCount; i++) {
+            if (latestMetrics[i].name == name || strcmp(latestMetrics[i].name, name) == 0) {
+                latestMetrics[i].value = value;
+                latestMetrics[i].timestamp_nanos = timestamp_nanos;
+                return;
+            }
+        }
+        
+        if (latestMetricCount < MAX_METRICS) {
+            LatestMetric& latest = latestMetrics[latestMetricCount++];
+            latest.name = name;
+            latest.value = value;
+            latest.timestamp_nanos = timestamp_nanos;
+        }
+    }
+    
+    // Copy a metric name with characters Prometheus does not allow replaced by '_'
+    static void formatPrometheusName(char* buffer, size_t size, const char* name) {
+        size_t length = 0;
+        for (const char* c = name; *c && length < size - 1; c++) {
+            bool valid = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || 
+                         (*c >= '0' && *c <= '9' && c != name) || *c == '_' || *c == ':';
+            buffer[length++] = valid ? *c : '_';
+        }
+        buffer[length] = '\0';
+    }
+    
     // Spans for tracing
     Span spans[MAX_SPANS];
     uint8_t spanCount;
     uint8_t activeSpanCount;
     
+    // Events of all spans, matched to their span by ID
+    SpanEvent spanEvents[OTEL_SPAN_EVENT_POOL];
+    
+    // Free the event slots of a span that is leaving the queue
+    void releaseSpanEvents(uint64_t spanId) {
+        for (uint8_t i = 0; i < OTEL_SPAN_EVENT_POOL; i++) {
+            if (spanEvents[i].spanId == spanId) {
+                spanEvents[i].spanId = 0;
+            }
+        }
+    }
+    
     // Current trace ID (used for all spans in a single trace)
     uint64_t currentTraceId[2];
     
-    // Pre-allocated buffer for JSON payload - reduced to save memory
-    char jsonBuffer[4096]; // Reduced from 8192 to 4096
+    // Optional vendor tracestate sent alongside traceparent (nullptr to omit)
+    const char* traceState;
+    
+    // Set while an export request is being built or sent. Export traffic must not create
+    // spans of its own, or every export would queue more trace data to export.
+    bool exportInProgress;
+    
+    // Marks export work for the lifetime of the scope, restoring the previous state on exit
+    struct ExportScope {
+        bool& flag;
+        bool previous;
+        ExportScope(bool& f) : flag(f), previous(f) { flag = true; }
+        ~ExportScope() { flag = previous; }
+    };
+    
+    // Pre-allocated buffer for one request body
+    char jsonBuffer[OTEL_MAX_PAYLOAD_BYTES];
+    
+    // Exact encoded bytes waiting to be sent, kept up to date as items are recorded
+    uint32_t pendingSpanBytes;
+    uint32_t pendingMetricBytes;
+    
+    // Optional explicit flush deadline in millis() (see setFlushDeadline)
+    unsigned long flushDeadline;
+    bool hasFlushDeadline;
     
+    // Optional capture tee - every encoded request is also written here (see setCaptureStream)
+    Print* captureStream;
+    
+    // Optional store for metric batches that could not be sent (see setRetention)
+    MetricRetention* retention;
+    uint32_t sentMetricBatches;       // Metric batches the collector accepted since boot
+    unsigned long retentionInterval;  // Least time between two retained batches (see setRetention)
+    unsigned long lastRetention;      // millis() of the last retained batch
+    bool hasRetained;
+    
+    // Optional extra collectors that get every request the primary accepted (see setFanout)
+    ExportFanout* fanout;
+    
+    // Request deadlines learned per endpoint from how long the collector takes to answer
+    RttEstimator metricsRtt;
+    RttEstimator tracesRtt;
+    
+    // Write one capture record: "#OTLPCAP <millis> <signal> <bytes> <payload>"
+    // The payload is single-line JSON, so records can be picked out of a mixed serial log
+    void writeCaptureRecord(char signal, const char* payload, size_t length) {
+        if (!captureStream) {
+            return;
+        }
+        
+        char header[48];
+        snprintf(header, sizeof(header), "%s %lu %c %u ", OTEL_CAPTURE_MARKER, 
+                 (unsigned long)millis(), signal, (unsigned)length);
+        captureStream->write((const uint8_t*)header, strlen(header));
+        captureStream->write((const uint8_t*)payload, length);
+        captureStream->write((uint8_t)'\n');
+    }
+    
+    // Append formatted text at `position`. With a null buffer nothing is written and only
+    // the length is counted, which is how encoded sizes are measured ahead of time.
     bool appendToBuffer(char* buffer, size_t& position, const size_t maxSize, const char* format, ...) {
         va_list args;
         va_start(args, format);
-        int written = vsnprintf(buffer + position, maxSize - position, format, args);
+        int written = buffer ? vsnprintf(buffer + position, maxSize - position, format, args)
+                             : vsnprintf(nullptr, 0, format, args);
         va_end(args);
         
-        if (written < 0 || written >= (int)(maxSize - position)) {
+        if (written < 0 || (buffer && written >= (int)(maxSize - position))) {
             // Buffer overflow would occur
             debugLog("Warning: JSON buffer overflow prevented");
             return false;
@@ -122,236 +385,407 @@ private:
         return true;
     }
     
-    bool createBatchPayload() {
-        size_t pos = 0;
-        
-        // Start the JSON structure
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), 
-                "{\"resourceMetrics\":[{\"resource\":{\"attributes\":[")) {
+    // Resource block shared by the metrics and traces payloads, opened by `prefix`
+    bool encodeResource(char* buffer, size_t& pos, size_t maxSize, const char* prefix) {
+        return appendToBuffer(buffer, pos, maxSize,
+                "%s{\"resource\":{\"attributes\":["
+                "{\"key\":\"service.name\",\"value\":{\"stringValue\":\"%s\"}},"
+                "{\"key\":\"service.version\",\"value\":{\"stringValue\":\"%s\"}},"
+                "{\"key\":\"wifi.ssid\",\"value\":{\"stringValue\":\"%s\"}}"
+                "]},",
+                prefix, serviceName, serviceVersion, WIFI_SSID);
+    }
+    
+    bool encodeMetricsHeader(char* buffer, size_t& pos, size_t maxSize) {
+        return encodeResource(buffer, pos, maxSize, "{\"resourceMetrics\":[") &&
+               appendToBuffer(buffer, pos, maxSize, "\"scopeMetrics\":[{\"metrics\":[");
+    }
+    
+    bool encodeTracesHeader(char* buffer, size_t& pos, size_t maxSize) {
+        return encodeResource(buffer, pos, maxSize, "{\"resourceSpans\":[") &&
+               appendToBuffer(buffer, pos, maxSize,
+                       "\"scopeSpans\":[{\"scope\":{\"name\":\"iototeldemo\"},\"spans\":[");
+    }
+    
+    // Both payloads close the same way: ]}]}]}
+    static const size_t PAYLOAD_FOOTER_SIZE = 6;
+    
+    // Bytes taken by the metrics payload envelope (everything except the metric points)
+    size_t metricsEnvelopeSize() {
+        size_t size = 0;
+        encodeMetricsHeader(nullptr, size, 0);
+        return size + PAYLOAD_FOOTER_SIZE;
+    }
+    
+    size_t tracesEnvelopeSize() {
+        size_t size = 0;
+        encodeTracesHeader(nullptr, size, 0);
+        return size + PAYLOAD_FOOTER_SIZE;
+    }
+    
+    // Encode one metric point (without the separating comma)
+    bool encodeMetricPoint(char* buffer, size_t& pos, size_t maxSize, const MetricPoint& point) {
+        char value[NUMERIC_VALUE_TEXT_SIZE];
+        point.value.format(value, sizeof(value));
+        
+        // Add the metric point with its timestamp
+        if (!appendToBuffer(buffer, pos, maxSize,
+                "{\"name\":\"%s\",\"gauge\":{\"dataPoints\":[{\"timeUnixNano\":\"%llu\",\"asDouble\":%s",
+                point.name, point.timestamp_nanos, value)) {
             return false;
         }
         
-        // Add resource attributes
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "{\"key\":\"service.name\",\"value\":{\"stringValue\":\"%s\"}},", serviceName)) {
-            return false;
+        // Link the point to the trace that explains it
+        if (point.exemplarSpanId != 0) {
+            if (!appendToBuffer(buffer, pos, maxSize,
+                    ",\"exemplars\":[{\"timeUnixNano\":\"%llu\",\"asDouble\":%s,"
+                    "\"traceId\":\"%016llx%016llx\",\"spanId\":\"%016llx\"}]",
+                    point.timestamp_nanos, value,
+                    point.exemplarTraceId[0], point.exemplarTraceId[1], point.exemplarSpanId)) {
+                return false;
+            }
         }
         
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "{\"key\":\"service.version\",\"value\":{\"stringValue\":\"%s\"}},", serviceVersion)) {
+        return appendToBuffer(buffer, pos, maxSize, "}]}}");
+    }
+    
+    // Encode one cumulative histogram point (without the separating comma)
+    bool encodeHistogramPoint(char* buffer, size_t& pos, size_t maxSize, const HistogramPoint& point) {
+        const Histogram& data = point.data;
+        if (!appendToBuffer(buffer, pos, maxSize,
+                "{\"name\":\"%s\",\"unit\":\"%s\",\"histogram\":{\"aggregationTemporality\":2,\"dataPoints\":[{",
+                point.name, point.unit)) {
             return false;
         }
-        
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "{\"key\":\"wifi.ssid\",\"value\":{\"stringValue\":\"%s\"}}", WIFI_SSID)) {
+        if (point.attributeKey &&
+            !appendToBuffer(buffer, pos, maxSize,
+                    "\"attributes\":[{\"key\":\"%s\",\"value\":{\"stringValue\":\"%s\"}}],",
+                    point.attributeKey, point.attributeValue)) {
             return false;
         }
-        
-        // Continue building JSON
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "]},"
-                "\"scopeMetrics\":[{\"metrics\":[")) {
+        if (!appendToBuffer(buffer, pos, maxSize,
+                "\"startTimeUnixNano\":\"%llu\",\"timeUnixNano\":\"%llu\",\"count\":\"%lu\","
+                "\"sum\":%llu,\"min\":%lu,\"max\":%lu,\"bucketCounts\":[",
+                (unsigned long long)point.startTimeNanos, (unsigned long long)point.timeNanos,
+                (unsigned long)data.count, (unsigned long long)data.sum, (unsigned long)data.min,
+                (unsigned long)data.max)) {
             return false;
         }
-        
-        // Add each metric
-        for (uint8_t i = 0; i < metricCount; i++) {
-            // Add comma if not the first metric
-            if (i > 0) {
-                if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",")) {
-                    return false;
-                }
+        for (uint8_t i = 0; i <= data.boundCount; i++) {
+            if (!appendToBuffer(buffer, pos, maxSize, "%s\"%lu\"", i > 0 ? "," : "",
+                                (unsigned long)data.bucketCounts[i])) {
+                return false;
             }
-            
-            // Add the metric point with its timestamp
-            if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                    "{\"name\":\"%s\",\"gauge\":{\"dataPoints\":[{\"timeUnixNano\":\"%llu\",\"asDouble\":%.2f}]}}",
-                    batchMetrics[i].name, batchMetrics[i].timestamp_nanos, batchMetrics[i].value)) {
+        }
+        if (!appendToBuffer(buffer, pos, maxSize, "],\"explicitBounds\":[")) {
+            return false;
+        }
+        for (uint8_t i = 0; i < data.boundCount; i++) {
+            if (!appendToBuffer(buffer, pos, maxSize, "%s%lu", i > 0 ? "," : "", (unsigned long)data.bounds[i])) {
                 return false;
             }
         }
+        return appendToBuffer(buffer, pos, maxSize, "]}]}}");
+    }
+    
+    // Encode a retained min/max/sum/count bucket as an OTLP summary (min and max are quantiles 0 and 1)
+    bool encodeRetainedBucket(char* buffer, size_t& pos, size_t maxSize, const RetainedBucket& bucket,
+                              uint32_t windowSeconds) {
+        char minValue[NUMERIC_VALUE_TEXT_SIZE];
+        char maxValue[NUMERIC_VALUE_TEXT_SIZE];
+        char sum[NUMERIC_VALUE_TEXT_SIZE];
+        NumericValue::formatFixed2(minValue, sizeof(minValue), bucket.min);
+        NumericValue::formatFixed2(maxValue, sizeof(maxValue), bucket.max);
+        NumericValue::formatFixed2(sum, sizeof(sum), bucket.sum);
+        
+        return appendToBuffer(buffer, pos, maxSize,
+                "{\"name\":\"%s\",\"summary\":{\"dataPoints\":[{\"startTimeUnixNano\":\"%llu\","
+                "\"timeUnixNano\":\"%llu\",\"count\":\"%u\",\"sum\":%s,\"quantileValues\":["
+                "{\"quantile\":0,\"value\":%s},{\"quantile\":1,\"value\":%s}]}]}}",
+                bucket.name, (unsigned long long)bucket.startSeconds * 1000000000ULL,
+                (unsigned long long)(bucket.startSeconds + windowSeconds) * 1000000000ULL,
+                (unsigned)bucket.count, sum, minValue, maxValue);
+    }
+    
+    // Encode a retained full-resolution reading as an ordinary gauge point
+    bool encodeRetainedPoint(char* buffer, size_t& pos, size_t maxSize, const RetainedPoint& retained,
+                             uint32_t) {
+        MetricPoint point(retained.name, NumericValue(retained.value), (uint64_t)retained.seconds * 1000000000ULL);
+        return encodeMetricPoint(buffer, pos, maxSize, point);
+    }
+    
+    // Fill jsonBuffer with as many entries of one retention tier as fit, oldest first.
+    // Returns the number of entries encoded (0 if not even one fits).
+    template <typename Tier, typename Encoder>
+    size_t createRetainedPayload(const Tier& tier, uint32_t windowSeconds, Encoder encode) {
+        size_t pos = 0;
+        if (!encodeMetricsHeader(jsonBuffer, pos, sizeof(jsonBuffer))) {
+            return 0;
+        }
         
-        // Close the JSON structure
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), "]}]}]}")) {
-            return false;
+        size_t count = 0;
+        for (; count < tier.size(); count++) {
+            size_t size = count > 0 ? 1 : 0;
+            (this->*encode)(nullptr, size, 0, tier.at(count), windowSeconds);
+            if (pos + size + PAYLOAD_FOOTER_SIZE >= sizeof(jsonBuffer)) {
+                break;
+            }
+            if (count > 0) {
+                appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",");
+            }
+            (this->*encode)(jsonBuffer, pos, sizeof(jsonBuffer), tier.at(count), windowSeconds);
         }
         
-        debugLog("OpenTelemetry metrics payload created");
-
-        return true;
+        if (count == 0 || !appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), "]}]}]}")) {
+            return 0;
+        }
+        return count;
     }
     
-    // Create trace payload for limited number of completed spans
-    bool createTracePayload() {
-        if (!serviceName) serviceName = "default";
-        if (!serviceVersion) serviceVersion = "0.0.0";
+    // Move the current batch into the retention store so it survives a failed send.
+    // Failed sends are retried on the next loop pass with freshly read sensors, so while the
+    // collector stays unreachable only one batch per retention interval is kept.
+    void retainBatch() {
+        if (!retention || metricCount == 0) {
+            return;
+        }
+        if (hasRetained && millis() - lastRetention < retentionInterval) {
+            debugLog("Dropped %d unsent metrics (last batch retained %lu ms ago)", metricCount,
+                     millis() - lastRetention);
+            metricCount = 0;
+            histogramCount = 0;
+            pendingMetricBytes = 0;
+            return;
+        }
+        lastRetention = millis();
+        hasRetained = true;
+        for (uint8_t i = 0; i < metricCount; i++) {
+            retention->retain(batchMetrics[i].name, batchMetrics[i].value.toFloat(), batchMetrics[i].timestamp_nanos);
+        }
+        debugLog("Retained %d unsent metrics (%u entries held)", metricCount, (unsigned)retention->size());
+        metricCount = 0;
+        histogramCount = 0;  // Cumulative, so the next export carries the same counts
+        pendingMetricBytes = 0;
+    }
+    
+    // Encode one key/value attribute, preceded by a comma unless it is the first in its list.
+    // `pool` is the text pool of the span the attribute belongs to.
+    bool encodeAttribute(char* buffer, size_t& pos, size_t maxSize, const SpanAttribute& attr, const char* pool,
+                         bool separator) {
+        if (attr.isString) {
+            return appendToBuffer(buffer, pos, maxSize, "%s{\"key\":\"%s\",\"value\":{\"stringValue\":\"%s\"}}",
+                                  separator ? "," : "", attr.key, attr.text(pool));
+        }
+        
+        char value[NUMERIC_VALUE_TEXT_SIZE];
+        attr.numericValue.format(value, sizeof(value));
+        return appendToBuffer(buffer, pos, maxSize, "%s{\"key\":\"%s\",\"value\":{\"doubleValue\":%s}}",
+                              separator ? "," : "", attr.key, value);
+    }
+    
+    // Encode one completed span (without the separating comma)
+    bool encodeSpan(char* buffer, size_t& pos, size_t maxSize, const Span& span) {
+        // Trace and span IDs are written as hex strings
+        if (!appendToBuffer(buffer, pos, maxSize,
+                "{\"traceId\":\"%016llx%016llx\",\"spanId\":\"%016llx\",",
+                span.traceId[0], span.traceId[1], span.spanId)) {
+            return false;
+        }
         
-        // Count completed spans
-        int completedSpanCount = 0;
-        for (uint8_t i = 0; i < spanCount; i++) {
-            if (!spans[i].isActive && spans[i].endTimeNanos > 0) {
-                completedSpanCount++;
+        // Add parent span ID if there is one
+        if (span.parentSpanId != 0) {
+            if (!appendToBuffer(buffer, pos, maxSize, "\"parentSpanId\":\"%016llx\",", span.parentSpanId)) {
+                return false;
             }
         }
         
-        if (completedSpanCount == 0) {
-            return false; // No completed spans to send
+        // Add name, start and end times
+        if (!appendToBuffer(buffer, pos, maxSize,
+                "\"name\":\"%s\",\"startTimeUnixNano\":\"%llu\",\"endTimeUnixNano\":\"%llu\",\"kind\":\"SPAN_KIND_INTERNAL\"",
+                span.name, span.startTimeNanos, span.endTimeNanos)) {
+            return false;
         }
         
-        // Limit the number of spans per batch to avoid buffer overflow
-        // Use a smaller limit to ensure we don't overflow the buffer
-        int spansToSend = min(completedSpanCount, MAX_SPANS_PER_BATCH);
-        
-        // To prevent buffer overflow, examine attribute density
-        int totalAttributes = 0;
-        for (uint8_t i = 0; i < spanCount; i++) {
-            if (!spans[i].isActive && spans[i].endTimeNanos > 0) {
-                totalAttributes += spans[i].attributeCount;
+        // Add attributes if there are any
+        if (span.attributeCount > 0) {
+            if (!appendToBuffer(buffer, pos, maxSize, ",\"attributes\":[")) {
+                return false;
+            }
+            
+            for (uint8_t j = 0; j < span.attributeCount; j++) {
+                if (!encodeAttribute(buffer, pos, maxSize, span.attributes[j], span.text, j > 0)) {
+                    return false;
+                }
+            }
+            
+            if (!appendToBuffer(buffer, pos, maxSize, "]")) {
+                return false;
             }
         }
         
-        // Calculate average attributes per span
-        float avgAttributesPerSpan = completedSpanCount > 0 ? (float)totalAttributes / completedSpanCount : 0;
-        
-        // Adjust spans to send based on attribute density
-        // Only limit spans if we have an extreme number of attributes (>15 per span on average)
-        if (avgAttributesPerSpan > 15.0) {
-            // Calculate how many spans we can send without overflowing
-            // Each attribute takes up roughly 100 bytes in JSON
-            // Buffer is 4096 bytes, with ~1000 bytes of overhead
-            // So we have about 3000 bytes for attributes
-            int maxAttributesInBatch = 3000 / 100; // ~30 attributes
-            int maxSpansToSend = max(3, maxAttributesInBatch / max(1, (int)avgAttributesPerSpan));
-            spansToSend = min(spansToSend, maxSpansToSend);
+        // Add events, oldest first
+        if (span.eventCount > 0) {
+            if (!appendToBuffer(buffer, pos, maxSize, ",\"events\":[")) {
+                return false;
+            }
             
-            debugLog("High attribute density (%.1f per span). Limiting batch to %d spans (total attrs: %d)", 
-                    avgAttributesPerSpan, spansToSend, totalAttributes);
-        } else {
-            debugLog("Creating trace payload with %d/%d completed spans (total attrs: %d)", 
-                    spansToSend, completedSpanCount, totalAttributes);
+            // Gather the span's events from the pool, oldest first
+            uint8_t order[MAX_SPAN_EVENTS];
+            uint8_t found = 0;
+            for (uint8_t i = 0; i < OTEL_SPAN_EVENT_POOL && found < MAX_SPAN_EVENTS; i++) {
+                if (spanEvents[i].spanId != span.spanId) {
+                    continue;
+                }
+                uint8_t k = found++;
+                for (; k > 0 && spanEvents[order[k - 1]].timeUnixNanos > spanEvents[i].timeUnixNanos; k--) {
+                    order[k] = order[k - 1];
+                }
+                order[k] = i;
+            }
+            
+            for (uint8_t j = 0; j < found; j++) {
+                const SpanEvent& event = spanEvents[order[j]];
+                if (!appendToBuffer(buffer, pos, maxSize, "%s{\"timeUnixNano\":\"%llu\",\"name\":\"%s\"",
+                                    j > 0 ? "," : "", event.timeUnixNanos, event.name)) {
+                    return false;
+                }
+                if (event.key) {
+                    SpanAttribute attribute = event.isString ? SpanAttribute(event.key, event.stringValue)
+                                                             : SpanAttribute(event.key, NumericValue(event.numericValue));
+                    if (!appendToBuffer(buffer, pos, maxSize, ",\"attributes\":[") ||
+                        !encodeAttribute(buffer, pos, maxSize, attribute, span.text, false) ||
+                        !appendToBuffer(buffer, pos, maxSize, "]")) {
+                        return false;
+                    }
+                }
+                if (!appendToBuffer(buffer, pos, maxSize, "}")) {
+                    return false;
+                }
+            }
+            
+            if (!appendToBuffer(buffer, pos, maxSize, "]")) {
+                return false;
+            }
+        }
+        
+        if (span.droppedEventCount > 0) {
+            if (!appendToBuffer(buffer, pos, maxSize, ",\"droppedEventsCount\":%u", span.droppedEventCount)) {
+                return false;
+            }
         }
         
+        // Close span JSON
+        return appendToBuffer(buffer, pos, maxSize, "}");
+    }
+    
+    // Exact encoded size of a span, measured once when it ends
+    uint16_t measureSpan(const Span& span) {
+        size_t size = 0;
+        encodeSpan(nullptr, size, 0, span);
+        return size > 0xFFFF ? 0xFFFF : (uint16_t)size;
+    }
+    
+    bool isPendingSpan(const Span& span) const {
+        return !span.isActive && span.endTimeNanos > 0 && !span.inFlight;
+    }
+    
+    bool createBatchPayload() {
         size_t pos = 0;
         
-        // Start the JSON structure for traces
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), 
-                "{\"resourceSpans\":[{\"resource\":{\"attributes\":[")) {
+        if (!encodeMetricsHeader(jsonBuffer, pos, sizeof(jsonBuffer))) {
             return false;
         }
         
-        // Add resource attributes
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "{\"key\":\"service.name\",\"value\":{\"stringValue\":\"%s\"}},", serviceName)) {
-            return false;
+        // Add each metric
+        for (uint8_t i = 0; i < metricCount; i++) {
+            // Add comma if not the first metric
+            if (i > 0) {
+                if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",")) {
+                    return false;
+                }
+            }
+            
+            if (!encodeMetricPoint(jsonBuffer, pos, sizeof(jsonBuffer), batchMetrics[i])) {
+                return false;
+            }
         }
         
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "{\"key\":\"service.version\",\"value\":{\"stringValue\":\"%s\"}},", serviceVersion)) {
-            return false;
+        // Histograms follow the gauges in the same request
+        for (uint8_t i = 0; i < histogramCount; i++) {
+            if ((metricCount > 0 || i > 0) && !appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",")) {
+                return false;
+            }
+            if (!encodeHistogramPoint(jsonBuffer, pos, sizeof(jsonBuffer), batchHistograms[i])) {
+                return false;
+            }
         }
         
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "{\"key\":\"wifi.ssid\",\"value\":{\"stringValue\":\"%s\"}}", WIFI_SSID)) {
+        // Close the JSON structure
+        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), "]}]}]}")) {
             return false;
         }
         
-        // Continue building JSON for scope spans
-        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                "]},"
-                "\"scopeSpans\":[{\"scope\":{\"name\":\"iototeldemo\"},"
-                "\"spans\":[")) {
+        debugLog("OpenTelemetry metrics payload created (%u bytes, %u predicted)", 
+                 (unsigned)pos, (unsigned)(metricsEnvelopeSize() + pendingMetricBytes));
+        
+        return true;
+    }
+    
+    // Create a trace payload holding as many pending spans as fit in one request.
+    // Spans are taken oldest first and the batch is cut at a span boundary, using the
+    // sizes measured when each span ended, so a request is always full and never overflows.
+    bool createTracePayload() {
+        if (!serviceName) serviceName = "default";
+        if (!serviceVersion) serviceVersion = "0.0.0";
+        
+        size_t pos = 0;
+        if (!encodeTracesHeader(jsonBuffer, pos, sizeof(jsonBuffer))) {
             return false;
         }
         
-        // Add completed spans (limited to MAX_SPANS_PER_BATCH)
-        bool firstSpan = true;
-        int spansSent = 0;
+        const size_t capacity = sizeof(jsonBuffer) - 1; // Leave room for the terminator
+        int spansInBatch = 0;
+        uint32_t batchBytes = 0;
         
-        for (uint8_t i = 0; i < spanCount && spansSent < spansToSend; i++) {
-            if (spans[i].isActive || spans[i].endTimeNanos == 0) {
-                continue; // Skip active or incomplete spans
+        for (uint8_t i = 0; i < spanCount; i++) {
+            if (!isPendingSpan(spans[i])) {
+                continue; // Skip active, incomplete or already batched spans
             }
             
-            // Add comma if not the first span
-            if (!firstSpan) {
-                if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",")) {
-                    return false;
+            size_t needed = spans[i].encodedSize + (spansInBatch > 0 ? 1 : 0);
+            if (pos + needed + PAYLOAD_FOOTER_SIZE > capacity) {
+                if (spansInBatch == 0) {
+                    // Too large to ever fit in a request - drop it rather than stall the queue
+                    debugLog("Warning: Span [%s] id=%016llx needs %u bytes and can never be sent, dropping it",
+                             spans[i].name, spans[i].spanId, spans[i].encodedSize);
+                    pendingSpanBytes -= spans[i].encodedSize;
+                    releaseSpanEvents(spans[i].spanId);
+                    spans[i].inFlight = true;
+                    spans[i].spanId = 0;
+                    continue;
                 }
+                break; // Next span starts the next request
             }
-            firstSpan = false;
-            
-            // Format trace and span IDs as hex strings
-            char traceIdHex[33]; // 128-bit (16 bytes) as 32 hex chars + null
-            char spanIdHex[17];  // 64-bit (8 bytes) as 16 hex chars + null
-            char parentSpanIdHex[17]; // 64-bit (8 bytes) as 16 hex chars + null
             
-            // Convert IDs to hex strings
-            sprintf(traceIdHex, "%016llx%016llx", spans[i].traceId[0], spans[i].traceId[1]);
-            sprintf(spanIdHex, "%016llx", spans[i].spanId);
-            sprintf(parentSpanIdHex, "%016llx", spans[i].parentSpanId);
-            
-            // Start span JSON
-            if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                    "{\"traceId\":\"%s\",\"spanId\":\"%s\",", traceIdHex, spanIdHex)) {
+            if (spansInBatch > 0 && !appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",")) {
                 return false;
             }
-            
-            // Add parent span ID if there is one
-            if (spans[i].parentSpanId != 0) {
-                if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), 
-                        "\"parentSpanId\":\"%s\",", parentSpanIdHex)) {
-                    return false;
-                }
-            }
-            
-            // Add name, start and end times
-            if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                    "\"name\":\"%s\",\"startTimeUnixNano\":\"%llu\",\"endTimeUnixNano\":\"%llu\",\"kind\":\"SPAN_KIND_INTERNAL\"",
-                    spans[i].name, spans[i].startTimeNanos, spans[i].endTimeNanos)) {
+#ifdef OTEL_DEBUG_VERBOSE
+            size_t spanStart = pos;
+#endif
+            if (!encodeSpan(jsonBuffer, pos, sizeof(jsonBuffer), spans[i])) {
                 return false;
             }
-            
-            // Add attributes if there are any
-            if (spans[i].attributeCount > 0) {
-                if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",\"attributes\":[")) {
-                    return false;
-                }
-                
-                for (uint8_t j = 0; j < spans[i].attributeCount; j++) {
-                    if (j > 0) {
-                        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), ",")) {
-                            return false;
-                        }
-                    }
-                    
-                    if (spans[i].attributes[j].isString) {
-                        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                                "{\"key\":\"%s\",\"value\":{\"stringValue\":\"%s\"}}",
-                                spans[i].attributes[j].key, spans[i].attributes[j].stringValue)) {
-                            return false;
-                        }
-                    } else {
-                        if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer),
-                                "{\"key\":\"%s\",\"value\":{\"doubleValue\":%.2f}}",
-                                spans[i].attributes[j].key, spans[i].attributes[j].doubleValue)) {
-                            return false;
-                        }
-                    }
-                }
-                
-                if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), "]")) {
-                    return false;
-                }
-            }
-            
-            // Close span JSON
-            if (!appendToBuffer(jsonBuffer, pos, sizeof(jsonBuffer), "}")) {
-                return false;
+#ifdef OTEL_DEBUG_VERBOSE
+            if (pos - spanStart != spans[i].encodedSize) {
+                debugLog("Warning: Span [%s] encoded to %u bytes, %u were measured",
+                         spans[i].name, (unsigned)(pos - spanStart), spans[i].encodedSize);
             }
+#endif
             
-            // Mark this span for removal after successful send
-            spans[i].endTimeNanos = 1; // Special marker to remove this span
-            spansSent++;
+            spans[i].inFlight = true;
+            batchBytes += spans[i].encodedSize;
+            spansInBatch++;
         }
         
         // Close the JSON structure
@@ -359,7 +793,12 @@ private:
             return false;
         }
         
-        debugLog("OpenTelemetry trace payload created (%d bytes, %d spans)", pos, spansSent);
+        if (spansInBatch == 0) {
+            return false;
+        }
+        
+        debugLog("OpenTelemetry trace payload created (%u bytes, %d spans, %lu bytes still pending)", 
+                 (unsigned)pos, spansInBatch, (unsigned long)(pendingSpanBytes - batchBytes));
         return true;
     }
     
@@ -380,14 +819,33 @@ private:
         return id;
     }
     
-    // Remove spans marked for removal (those with endTimeNanos == 1)
-    void removeMarkedSpans() {
+    // Finish a span: record its end time, fetch deferred attribute values and measure its
+    // exact encoded size for batching. Nothing the encoder reads changes after this (deferred
+    // strings are copied into the span), so the size still holds when the span is sent.
+    void completeSpan(Span& span) {
+        for (uint8_t i = 0; i < span.attributeCount; i++) {
+            span.attributes[i].resolve(span.text, span.textUsed);
+        }
+        span.isActive = false;
+        span.endTimeNanos = getCurrentTimeNanos();
+        span.completedAtMillis = millis();
+        span.encodedSize = measureSpan(span);
+        activeSpanCount--;
+        pendingSpanBytes += span.encodedSize;
+    }
+    
+    // Remove spans whose batch was delivered (and spans dropped while batching)
+    void removeSentSpans() {
         uint8_t newSpanCount = 0;
         uint8_t removed = 0;
         
         for (uint8_t i = 0; i < spanCount; i++) {
-            if (!spans[i].isActive && spans[i].endTimeNanos == 1) {
-                // Skip this span (it was sent)
+            if (!spans[i].isActive && spans[i].inFlight) {
+                // Skip this span (it was sent); dropped spans were already taken off the total
+                if (spans[i].spanId != 0) {
+                    pendingSpanBytes -= spans[i].encodedSize;
+                    releaseSpanEvents(spans[i].spanId);
+                }
                 removed++;
             } else {
                 // Keep this span
@@ -399,85 +857,180 @@ private:
             }
         }
         
-        spanCount = newSpanCount;
-        if (removed > 0) {
-            debugLog("Removed %d spans after successful trace send", removed);
-        }
+        spanCount = newSpanCount;
+        if (removed > 0) {
+            debugLog("Removed %d spans after trace send", removed);
+        }
+    }
+    
+    // Put the spans of a failed batch back in the queue so they go out with the next flush
+    void requeueInFlightSpans() {
+        for (uint8_t i = 0; i < spanCount; i++) {
+            if (spans[i].inFlight && spans[i].spanId != 0) {
+                spans[i].inFlight = false;
+            }
+        }
+        removeSentSpans(); // Only spans dropped while batching are still marked
+    }
+    
+    // Called when every span slot is taken: flush first, then end leaked active spans,
+    // and finally drop the oldest completed spans that could not be delivered
+    void makeRoomForSpan() {
+        debugLog("Span slots full (%d/%d), flushing completed spans", spanCount, MAX_SPANS);
+        sendTraces();
+        
+        if (spanCount < MAX_SPANS) {
+            return;
+        }
+        
+        // If most slots hold active spans, something is starting spans without ending them
+        if (activeSpanCount > MAX_SPANS / 2) {
+            debugLog("WARNING: Too many active spans (%d) - possible leak", activeSpanCount);
+            
+            // Force end the oldest active spans
+            int activeEnded = 0;
+            for (uint8_t i = 0; i < spanCount && activeSpanCount > MAX_SPANS / 2; i++) {
+                if (spans[i].isActive) {
+                    completeSpan(spans[i]);
+                    activeEnded++;
+                    
+                    debugLog("Force-ended active span: %s (ID: %016llx)", 
+                            spans[i].name, spans[i].spanId);
+                }
+            }
+            debugLog("Force-ended %d active spans to prevent memory leak", activeEnded);
+        }
+        
+        // Free a quarter of the slots by dropping the oldest completed spans
+        uint8_t dropped = 0;
+        for (uint8_t i = 0; i < spanCount && dropped < MAX_SPANS / 4; i++) {
+            if (isPendingSpan(spans[i])) {
+                pendingSpanBytes -= spans[i].encodedSize;
+                releaseSpanEvents(spans[i].spanId);
+                spans[i].inFlight = true;
+                spans[i].spanId = 0;
+                dropped++;
+            }
+        }
+        
+        if (dropped > 0) {
+            debugLog("Dropped %d undeliverable completed spans", dropped);
+            removeSentSpans();
+        }
+    }
+
+    // Append an attribute to an active span
+    bool storeSpanAttribute(uint64_t spanId, const SpanAttribute& attribute, const char* copiedText = nullptr) {
+        if (spanId == 0) {
+            return false;
+        }
+        
+        for (uint8_t i = 0; i < spanCount; i++) {
+            Span& span = spans[i];
+            if (span.spanId != spanId) {
+                continue;
+            }
+            if (!span.isActive) {
+#ifdef OTEL_DEBUG_VERBOSE
+                debugLog("Warning: Cannot add attribute '%s' to ended span [%s] id=%016llx", 
+                         attribute.key, span.name, spanId);
+#endif
+                return false;
+            }
+            if (span.attributeCount >= MAX_SPAN_ATTRS) {
+                debugLog("Warning: Maximum attributes reached for span [%s] id=%016llx", span.name, spanId);
+                return false;
+            }
+            
+            SpanAttribute& stored = span.attributes[span.attributeCount++];
+            stored = attribute;
+            if (copiedText) {
+                stored.copyText(copiedText, span.text, span.textUsed);
+            }
+            return true;
+        }
+        
+#ifdef OTEL_DEBUG_VERBOSE
+        debugLog("Warning: Span not found: %016llx", spanId);
+#endif
+        return false;
     }
-
-    // Add this method to clean up old spans when we're getting close to the limit
-    void cleanupOldSpans() {
-        // If we've reached 60% of maximum capacity, force send completed traces
-        if (spanCount >= (MAX_SPANS * 60 / 100)) {
-            debugLog("Cleaning up spans, reached %d%% of capacity (%d/%d)", 
-                    (spanCount * 100) / MAX_SPANS, spanCount, MAX_SPANS);
-            sendTraces();
+    
+    // Add an event to a span. A span that already holds MAX_SPAN_EVENTS overwrites its oldest;
+    // when the shared pool is full the new event is dropped. Both are counted on the span.
+    bool recordSpanEvent(uint64_t spanId, const char* name, const char* key, const char* stringValue,
+                         float numericValue, bool isString) {
+        if (spanId == 0 || !name) {
+            return false;
+        }
+        
+        for (uint8_t i = 0; i < spanCount; i++) {
+            Span& span = spans[i];
+            if (span.spanId != spanId) {
+                continue;
+            }
+            if (!span.isActive) {
+#ifdef OTEL_DEBUG_VERBOSE
+                debugLog("Warning: Cannot add event '%s' to ended span [%s] id=%016llx", name, span.name, spanId);
+#endif
+                return false;
+            }
             
-            // See if we still have too many spans
-            if (spanCount >= (MAX_SPANS * 60 / 100)) {
-                debugLog("Still have %d spans after sending traces", spanCount);
-                
-                // Count how many completed spans we have
-                int completedCount = 0;
-                for (uint8_t i = 0; i < spanCount; i++) {
-                    if (!spans[i].isActive) {
-                        completedCount++;
-                    }
-                }
-                
-                // If we have completed spans, remove them aggressively
-                if (completedCount > 0) {
-                    debugLog("Found %d completed spans to remove", completedCount);
-                    
-                    uint8_t newSpanCount = 0;
-                    for (uint8_t i = 0; i < spanCount; i++) {
-                        if (spans[i].isActive) {
-                            // Keep active spans
-                            if (i != newSpanCount) {
-                                spans[newSpanCount] = spans[i];
-                            }
-                            newSpanCount++;
-                        }
+            uint8_t slot = OTEL_SPAN_EVENT_POOL;
+            if (span.eventCount < MAX_SPAN_EVENTS) {
+                for (uint8_t j = 0; j < OTEL_SPAN_EVENT_POOL; j++) {
+                    if (spanEvents[j].spanId == 0) {
+                        slot = j;
+                        span.eventCount++;
+                        break;
                     }
-                    
-                    uint8_t removedSpans = spanCount - newSpanCount;
-                    spanCount = newSpanCount;
-                    debugLog("Removed %d completed spans", removedSpans);
                 }
-                
-                // If we still have too many spans, we have a leak of active spans
-                if (spanCount >= (MAX_SPANS * 80 / 100)) {
-                    debugLog("WARNING: Too many active spans (%d) - possible leak", spanCount);
-                    
-                    // Force end the oldest active spans
-                    int activeEnded = 0;
-                    for (uint8_t i = 0; i < spanCount && spanCount - activeEnded > (MAX_SPANS / 2); i++) {
-                        if (spans[i].isActive) {
-                            spans[i].isActive = false;
-                            spans[i].endTimeNanos = getCurrentTimeNanos();
-                            activeSpanCount--;
-                            activeEnded++;
-                            
-                            debugLog("Force-ended active span: %s (ID: %016llx)", 
-                                    spans[i].name, spans[i].spanId);
-                        }
-                    }
-                    
-                    if (activeEnded > 0) {
-                        debugLog("Force-ended %d active spans to prevent memory leak", activeEnded);
-                        
-                        // Now send these ended spans
-                        sendTraces();
+            } else {
+                // Reuse the span's oldest event
+                for (uint8_t j = 0; j < OTEL_SPAN_EVENT_POOL; j++) {
+                    if (spanEvents[j].spanId == spanId &&
+                        (slot == OTEL_SPAN_EVENT_POOL || spanEvents[j].timeUnixNanos < spanEvents[slot].timeUnixNanos)) {
+                        slot = j;
                     }
                 }
+                span.droppedEventCount++;
             }
+            if (slot == OTEL_SPAN_EVENT_POOL) {
+                span.droppedEventCount++;
+#ifdef OTEL_DEBUG_VERBOSE
+                debugLog("Warning: Event pool full, dropped event %s of span [%s]", name, span.name);
+#endif
+                return false;
+            }
+            
+            SpanEvent& event = spanEvents[slot];
+            event.spanId = spanId;
+            event.name = name;
+            event.key = key;
+            event.stringValue = stringValue;
+            event.numericValue = numericValue;
+            event.isString = isString;
+            event.timeUnixNanos = getCurrentTimeNanos();
+            
+#ifdef OTEL_DEBUG_VERBOSE
+            debugLog("Added event %s to span [%s] id=%016llx", name, span.name, spanId);
+#endif
+            return true;
         }
+        
+#ifdef OTEL_DEBUG_VERBOSE
+        debugLog("Warning: Span not found: %016llx", spanId);
+#endif
+        return false;
     }
 
 public:
     OpenTelemetry() : serviceName(OTEL_SERVICE_NAME), serviceVersion(OTEL_SERVICE_VERSION), 
                      metricsEndpoint(OTEL_METRICS_URL), tracesEndpoint(OTEL_TRACES_URL),
-                     lastHttpCode(0), metricCount(0), spanCount(0), activeSpanCount(0) {
+                     lastHttpCode(0), metricCount(0), histogramCount(0), latestMetricCount(0), spanCount(0), activeSpanCount(0),
+                     traceState(nullptr), exportInProgress(false), pendingSpanBytes(0), pendingMetricBytes(0),
+                     flushDeadline(0), hasFlushDeadline(false), captureStream(nullptr), retention(nullptr),
+                     sentMetricBatches(0), retentionInterval(0), lastRetention(0), hasRetained(false), fanout(nullptr) {
         memset(currentTraceId, 0, sizeof(currentTraceId));
         debugLog("OpenTelemetry instance created");
         // Random seed will be initialized in generateRandomId when needed
@@ -498,8 +1051,18 @@ public:
         lastErrorMessage = "None";
         lastHttpCode = 0;
         metricCount = 0;
+        histogramCount = 0;
         spanCount = 0;
         activeSpanCount = 0;
+        for (uint8_t i = 0; i < OTEL_SPAN_EVENT_POOL; i++) {
+            spanEvents[i].spanId = 0;
+        }
+        pendingSpanBytes = 0;
+        pendingMetricBytes = 0;
+        
+        // Metrics and traces go to the same collector, so keep one connection alive
+        // and drain both signals back to back over it
+        http.setReuse(true);
         
         // Initialize current trace ID
         currentTraceId[0] = generateRandomId();
@@ -509,16 +1072,132 @@ public:
         debugLog("OpenTelemetry initialized with traces endpoint: %s", tracesEndpoint);
     }
     
-    bool addMetric(const char* name, double value, uint64_t timestamp_nanos) {
+    // Add a metric point; the currently active span (if any) is attached as its exemplar
+    bool addMetric(const char* name, float value, uint64_t timestamp_nanos) {
+        return addMetricPoint(name, NumericValue(value), timestamp_nanos, getActiveSpanId());
+    }
+    
+    // Add a metric point with an explicit exemplar span (0 for none). The span may already
+    // have ended, e.g. the span in which a sensor value was read.
+    bool addMetric(const char* name, float value, uint64_t timestamp_nanos, uint64_t exemplarSpanId) {
+        return addMetricPoint(name, NumericValue(value), timestamp_nanos, exemplarSpanId);
+    }
+    
+    // Double-precision variants, for the rare value that does not survive float
+    bool addMetricDouble(const char* name, double value, uint64_t timestamp_nanos) {
+        return addMetricPoint(name, NumericValue::fromDouble(value), timestamp_nanos, getActiveSpanId());
+    }
+    
+    bool addMetricDouble(const char* name, double value, uint64_t timestamp_nanos, uint64_t exemplarSpanId) {
+        return addMetricPoint(name, NumericValue::fromDouble(value), timestamp_nanos, exemplarSpanId);
+    }
+    
+    // Add a point from an already-built value (float or double)
+    bool addMetricPoint(const char* name, NumericValue value, uint64_t timestamp_nanos, uint64_t exemplarSpanId) {
         if (metricCount >= MAX_METRICS) {
             debugLog("Warning: Maximum metrics count reached (%d). Metric not added.", MAX_METRICS);
             return false;
         }
         
-        batchMetrics[metricCount++] = MetricPoint(name, value, timestamp_nanos);
+        MetricPoint point(name, value, timestamp_nanos);
+        
+        if (exemplarSpanId != 0) {
+            for (uint8_t i = 0; i < spanCount; i++) {
+                if (spans[i].spanId == exemplarSpanId) {
+                    point.exemplarSpanId = exemplarSpanId;
+                    point.exemplarTraceId[0] = spans[i].traceId[0];
+                    point.exemplarTraceId[1] = spans[i].traceId[1];
+                    break;
+                }
+            }
+        }
+        
+        // Refuse points that would not fit in one request instead of failing the whole batch later
+        size_t pointBytes = 0;
+        encodeMetricPoint(nullptr, pointBytes, 0, point);
+        pointBytes += metricCount + histogramCount > 0 ? 1 : 0; // Separating comma
+        if (metricsEnvelopeSize() + pendingMetricBytes + pointBytes >= sizeof(jsonBuffer)) {
+            debugLog("Warning: Metric %s (%u bytes) does not fit in the current request. Metric not added.", 
+                     name, (unsigned)pointBytes);
+            return false;
+        }
+        
+        batchMetrics[metricCount++] = point;
+        pendingMetricBytes += pointBytes;
+        
+        updateLatestMetric(name, value, timestamp_nanos);
+        return true;
+    }
+    
+    // Add a cumulative histogram point to the next metrics request, with an optional string
+    // attribute. Returns false if the request has no room for it; the caller can add it again
+    // next time, as the counts only grow.
+    bool addHistogram(const char* name, const char* unit, const Histogram& data, uint64_t startTimeNanos,
+                      uint64_t timeNanos, const char* attributeKey = nullptr, const char* attributeValue = nullptr) {
+        if (histogramCount >= MAX_HISTOGRAMS) {
+            debugLog("Warning: Maximum histogram count reached (%d). Histogram %s not added.", MAX_HISTOGRAMS, name);
+            return false;
+        }
+        
+        HistogramPoint& point = batchHistograms[histogramCount];
+        point.name = name;
+        point.unit = unit;
+        point.attributeKey = attributeKey;
+        point.attributeValue = attributeValue;
+        point.startTimeNanos = startTimeNanos;
+        point.timeNanos = timeNanos;
+        point.data = data;
+        
+        size_t pointBytes = 0;
+        encodeHistogramPoint(nullptr, pointBytes, 0, point);
+        pointBytes += metricCount + histogramCount > 0 ? 1 : 0; // Separating comma
+        if (metricsEnvelopeSize() + pendingMetricBytes + pointBytes >= sizeof(jsonBuffer)) {
+            debugLog("Warning: Histogram %s (%u bytes) does not fit in this request", name, (unsigned)pointBytes);
+            return false;
+        }
+        
+        histogramCount++;
+        pendingMetricBytes += pointBytes;
         return true;
     }
     
+    // Stream the latest value of every metric in the Prometheus text exposition format
+    // Written straight to `out` (e.g. a WiFiClient) without building the response in memory
+    size_t writePrometheusMetrics(Print& out) {
+        char name[OTEL_PROMETHEUS_NAME_SIZE];
+        char number[NUMERIC_VALUE_TEXT_SIZE];
+        // Both lines of a series, so each costs one socket write instead of one per piece
+        char series[2 * OTEL_PROMETHEUS_NAME_SIZE + NUMERIC_VALUE_TEXT_SIZE + 96];
+        
+        for (uint8_t i = 0; i < latestMetricCount; i++) {
+            const LatestMetric& metric = latestMetrics[i];
+            formatPrometheusName(name, sizeof(name), metric.name);
+            metric.value.format(number, sizeof(number));
+            
+            int length = snprintf(series, sizeof(series), "# TYPE %s gauge\n%s{service_name=\"%s\"} %s %llu\n",
+                                  name, name, serviceName, number,
+                                  (unsigned long long)(metric.timestamp_nanos / 1000000ULL));
+            if (length > 0 && (size_t)length < sizeof(series)) {
+                out.write((const uint8_t*)series, length);
+                continue;
+            }
+            
+            // A long service name does not fit the line buffer; write the series in pieces
+            out.print("# TYPE ");
+            out.print(name);
+            out.print(" gauge\n");
+            out.print(name);
+            out.print("{service_name=\"");
+            out.print(serviceName);
+            out.print("\"} ");
+            out.print(number);
+            snprintf(number, sizeof(number), " %llu\n", (unsigned long long)(metric.timestamp_nanos / 1000000ULL));
+            out.print(number);
+        }
+        
+        return latestMetricCount;
+    }
+    
     // Start a new trace (resets the current trace ID)
     void startNewTrace() {
         // Generate new trace ID
@@ -533,10 +1212,17 @@ public:
     
     // Start a new span with the given name
     uint64_t startSpan(const char* name, uint64_t parentSpanId = 0) {
-        // Clean up old spans if we're getting close to the limit
-        if (spanCount >= (MAX_SPANS * 3 / 4)) {
-            debugLog("Warning: Span count high (%d/%d), cleaning up old spans", spanCount, MAX_SPANS);
-            cleanupOldSpans();
+        // Never trace the exporter itself
+        if (exportInProgress) {
+#ifdef OTEL_DEBUG_VERBOSE
+            debugLog("Span [%s] suppressed during export", name);
+#endif
+            return 0;
+        }
+        
+        // Make room if every span slot is taken
+        if (spanCount >= MAX_SPANS) {
+            makeRoomForSpan();
         }
         
         if (spanCount >= MAX_SPANS) {
@@ -559,7 +1245,12 @@ public:
         span.startTimeNanos = getCurrentTimeNanos();
         span.endTimeNanos = 0;
         span.attributeCount = 0;
+        span.textUsed = 0;
+        span.eventCount = 0;
+        span.droppedEventCount = 0;
         span.isActive = true;
+        span.inFlight = false;
+        span.encodedSize = 0;
         
         activeSpanCount++;
         
@@ -572,7 +1263,8 @@ public:
         return spanId;
     }
     
-    // Add string attribute to a span
+    // Add string attribute to a span. Only the pointer is kept, so the value must outlive the
+    // span (a literal); use addSpanAttributeCopy for text in a buffer that gets reused.
     bool addSpanAttribute(uint64_t spanId, const char* key, const char* value) {
         if (spanId == 0) {
 #ifdef OTEL_DEBUG_VERBOSE
@@ -603,11 +1295,7 @@ public:
                     return false;
                 }
                 
-                SpanAttribute& attr = spans[i].attributes[spans[i].attributeCount++];
-                attr.key = key;
-                attr.stringValue = value;
-                attr.doubleValue = 0;
-                attr.isString = true;
+                spans[i].attributes[spans[i].attributeCount++] = SpanAttribute(key, value);
                 
 #ifdef OTEL_DEBUG_VERBOSE
                 // Get trace ID as hex for logging
@@ -626,8 +1314,24 @@ public:
         return false;
     }
     
+    // Add a string attribute copied into the span right away, for text in a buffer that gets
+    // reused (e.g. the last error). Shares the span's SPAN_TEXT_POOL_SIZE bytes of text.
+    bool addSpanAttributeCopy(uint64_t spanId, const char* key, const char* value) {
+        return storeSpanAttribute(spanId, SpanAttribute(key, (const char*)nullptr), value);
+    }
+    
     // Add numeric attribute to a span
-    bool addSpanAttribute(uint64_t spanId, const char* key, double value) {
+    bool addSpanAttribute(uint64_t spanId, const char* key, float value) {
+        return addSpanAttributeValue(spanId, key, NumericValue(value));
+    }
+    
+    // Double-precision variant, for the rare value that does not survive float
+    bool addSpanAttributeDouble(uint64_t spanId, const char* key, double value) {
+        return addSpanAttributeValue(spanId, key, NumericValue::fromDouble(value));
+    }
+    
+    // Add an already-built numeric value (float or double) to a span
+    bool addSpanAttributeValue(uint64_t spanId, const char* key, NumericValue value) {
         if (spanId == 0) {
 #ifdef OTEL_DEBUG_VERBOSE
             debugLog("Warning: Cannot add attribute to invalid span ID 0");
@@ -657,18 +1361,14 @@ public:
                     return false;
                 }
                 
-                SpanAttribute& attr = spans[i].attributes[spans[i].attributeCount++];
-                attr.key = key;
-                attr.stringValue = nullptr;
-                attr.doubleValue = value;
-                attr.isString = false;
+                spans[i].attributes[spans[i].attributeCount++] = SpanAttribute(key, value);
                 
 #ifdef OTEL_DEBUG_VERBOSE
                 // Get trace ID as hex for logging
                 char traceIdHex[33];
                 getCurrentTraceIdHex(traceIdHex, sizeof(traceIdHex));
                 debugLog("Added attribute %s=%f to span [%s] id=%016llx trace=%s", 
-                         key, value, spans[i].name, spanId, traceIdHex);
+                         key, value.toDouble(), spans[i].name, spanId, traceIdHex);
 #endif
                 return true;
             }
@@ -680,6 +1380,30 @@ public:
         return false;
     }
     
+    // Add an attribute whose value is only fetched when the span ends. Nothing is called for
+    // span ID 0 (unsampled or tracing disabled), so the value costs no I/O in that case.
+    // String values are copied into the span then, up to SPAN_TEXT_POOL_SIZE bytes per span.
+    bool addSpanAttributeLazy(uint64_t spanId, const char* key, NumericAttributeProvider provider) {
+        return storeSpanAttribute(spanId, SpanAttribute(key, provider));
+    }
+    
+    bool addSpanAttributeLazy(uint64_t spanId, const char* key, StringAttributeProvider provider) {
+        return storeSpanAttribute(spanId, SpanAttribute(key, provider));
+    }
+    
+    // Record a named point in time inside an active span - far cheaper than a short child span
+    bool addSpanEvent(uint64_t spanId, const char* name) {
+        return recordSpanEvent(spanId, name, nullptr, nullptr, 0, true);
+    }
+    
+    bool addSpanEvent(uint64_t spanId, const char* name, const char* key, const char* value) {
+        return recordSpanEvent(spanId, name, key, value, 0, true);
+    }
+    
+    bool addSpanEvent(uint64_t spanId, const char* name, const char* key, float value) {
+        return recordSpanEvent(spanId, name, key, nullptr, value, false);
+    }
+    
     // End a span with the given ID
     bool endSpan(uint64_t spanId) {
         if (spanId == 0) {
@@ -695,17 +1419,16 @@ public:
                     return false;
                 }
                 
-                spans[i].isActive = false;
-                spans[i].endTimeNanos = getCurrentTimeNanos();
-                activeSpanCount--;
+                completeSpan(spans[i]);
                 
                 // Get trace ID as hex for logging
                 char traceIdHex[33];
                 sprintf(traceIdHex, "%016llx%016llx", spans[i].traceId[0], spans[i].traceId[1]);
                 
                 uint64_t durationMicros = (spans[i].endTimeNanos - spans[i].startTimeNanos) / 1000;
-                debugLog("Ended span [%s] id=%016llx trace=%s duration=%llu µs (total=%d, active=%d)", 
-                         spans[i].name, spanId, traceIdHex, durationMicros, spanCount, activeSpanCount);
+                debugLog("Ended span [%s] id=%016llx trace=%s duration=%llu µs size=%u bytes (total=%d, active=%d, pending=%lu bytes)", 
+                         spans[i].name, spanId, traceIdHex, durationMicros, spans[i].encodedSize, 
+                         spanCount, activeSpanCount, (unsigned long)pendingSpanBytes);
                 return true;
             }
         }
@@ -714,27 +1437,26 @@ public:
         return false;
     }
     
-    // Send completed traces
+    // Send completed traces, one full request at a time, until nothing is pending
     bool sendTraces() {
+        ExportScope exportScope(exportInProgress);
+        
         // Make sure we have completed spans to send
-        bool hasCompletedSpans = false;
         int completedSpanCount = 0;
         for (uint8_t i = 0; i < spanCount; i++) {
-            if (!spans[i].isActive && spans[i].endTimeNanos > 0) {
-                hasCompletedSpans = true;
+            if (isPendingSpan(spans[i])) {
                 completedSpanCount++;
-                debugLog("Found completed span [%s] id=%016llx endTime=%llu", 
-                        spans[i].name, spans[i].spanId, spans[i].endTimeNanos);
             }
         }
         
-        if (!hasCompletedSpans) {
+        if (completedSpanCount == 0) {
             debugLog("No completed spans to send (total spans: %d, active: %d)", 
                     spanCount, activeSpanCount);
+            hasFlushDeadline = false;
             return true; // No spans to send is not an error
         }
         
-        debugLog("Found %d completed spans to send", completedSpanCount);
+        debugLog("Found %d completed spans to send (%lu bytes)", completedSpanCount, (unsigned long)pendingSpanBytes);
         
         // Make sure we have a valid endpoint
         if (!tracesEndpoint || strlen(tracesEndpoint) == 0) {
@@ -745,115 +1467,96 @@ public:
         
         debugLog("Using traces endpoint: %s", tracesEndpoint);
         
-        // Make sure JSON buffer is initialized
-        memset(jsonBuffer, 0, sizeof(jsonBuffer));
-        
-        // Create the JSON payload
-        if (!createTracePayload()) {
-            lastErrorMessage = "Failed to create trace payload";
-            debugLog("Error: %s", lastErrorMessage.c_str());
-            return false;
-        }
-        
-        // Log the complete payload for debugging
-        debugLog("Complete trace payload (%d bytes):", strlen(jsonBuffer));
-        // Split the payload into chunks to avoid truncation
-        const char* payload = jsonBuffer;
-        int remaining = strlen(payload);
-        int offset = 0;
-        while (remaining > 0) {
-            int chunkSize = min(200, remaining);
-            char chunk[201];
-            strncpy(chunk, payload + offset, chunkSize);
-            chunk[chunkSize] = '\0';
-            debugLog("%s", chunk);
-            remaining -= chunkSize;
-            offset += chunkSize;
-        }
-        
-        // Send the data
-        http.setTimeout(10000); // 10 second timeout for trace data
-        http.begin(tracesEndpoint);
-        http.addHeader("Content-Type", "application/json");
-        
-        // Log the complete request details
-        debugLog("HTTP Request Details:");
-        debugLog("POST %s", tracesEndpoint);
-        debugLog("Headers:");
-        debugLog("  Content-Type: application/json");
-        debugLog("Body:");
-        // Split the body into chunks to avoid truncation
-        payload = jsonBuffer;
-        remaining = strlen(payload);
-        offset = 0;
-        while (remaining > 0) {
-            int chunkSize = min(200, remaining);
-            char chunk[201];
-            strncpy(chunk, payload + offset, chunkSize);
-            chunk[chunkSize] = '\0';
-            debugLog("%s", chunk);
-            remaining -= chunkSize;
-            offset += chunkSize;
-        }
-        
-        // Send the request
-        int httpCode = http.POST(jsonBuffer);
-        lastHttpCode = httpCode;
-        
-        // Check for success (HTTP 200-299)
-        bool success = (httpCode >= 200 && httpCode < 300);
-        
-        if (success) {
-            debugLog("OpenTelemetry traces sent successfully (HTTP %d)", httpCode);
-            debugLog("Response body: %s", http.getString().c_str());
+        while (hasPendingSpans()) {
+            // Make sure JSON buffer is initialized
+            memset(jsonBuffer, 0, sizeof(jsonBuffer));
             
-            // Mark sent spans for cleanup
-            int spansMoved = 0;
-            for (uint8_t i = 0; i < spanCount; i++) {
-                if (!spans[i].isActive && spans[i].endTimeNanos > 0) {
-                    spans[i].spanId = 0; // Mark for cleanup
-                    spansMoved++;
-                    debugLog("Marked span [%s] id=%016llx for cleanup", 
-                            spans[i].name, spans[i].spanId);
-                    
-                    // Avoid processing too many in one batch
-                    if (spansMoved >= MAX_SPANS_PER_BATCH) {
-                        break;
-                    }
+            // Create the JSON payload
+            if (!createTracePayload()) {
+                requeueInFlightSpans();
+                if (!hasPendingSpans()) {
+                    break; // Everything left was dropped as oversized
                 }
+                lastErrorMessage = "Failed to create trace payload";
+                debugLog("Error: %s", lastErrorMessage.c_str());
+                return false;
             }
             
-            // Clean up spans that were sent
-            removeMarkedSpans();
+            // Send the data
+            uint32_t timeout = applyRequestTimeout(http, tracesRtt);
+            http.begin(tracesEndpoint);
+            http.addHeader("Content-Type", "application/json");
+            addTraceHeaders(http);
             
-            // If we still have more spans to send, send another batch
-            for (uint8_t i = 0; i < spanCount; i++) {
-                if (!spans[i].isActive && spans[i].endTimeNanos > 0) {
-                    debugLog("More spans to send. Recursively calling sendTraces()");
-                    sendTraces(); // Recursive call to send more spans
-                    break;
-                }
+            // Log the complete request details
+            debugLog("HTTP Request Details:");
+            debugLog("POST %s", tracesEndpoint);
+            debugLog("Headers:");
+            debugLog("  Content-Type: application/json");
+            debugLog("Body (%d bytes):", strlen(jsonBuffer));
+            // Split the body into chunks to avoid truncation
+            const char* payload = jsonBuffer;
+            int remaining = strlen(payload);
+            int offset = 0;
+            while (remaining > 0) {
+                int chunkSize = min(200, remaining);
+                char chunk[201];
+                strncpy(chunk, payload + offset, chunkSize);
+                chunk[chunkSize] = '\0';
+                debugLog("%s", chunk);
+                remaining -= chunkSize;
+                offset += chunkSize;
             }
             
-            return true;
-        } else {
-            // Record error and log it
-            lastErrorMessage = http.errorToString(httpCode);
-            if (httpCode > 0) {
-                String response = http.getString();
-                debugLog("OpenTelemetry trace send failed: HTTP error %d: %s", httpCode, lastErrorMessage.c_str());
-                debugLog("Response: %s", response.c_str());
-            } else {
-                debugLog("OpenTelemetry trace send failed: Connection error: %s", lastErrorMessage.c_str());
+            // Send the request
+            writeCaptureRecord('T', jsonBuffer, strlen(jsonBuffer));
+            unsigned long startTime = millis();
+            int httpCode = http.POST(jsonBuffer);
+            noteRequestResult(tracesRtt, httpCode, millis() - startTime, timeout);
+            lastHttpCode = httpCode;
+            
+            // Check for success (HTTP 200-299)
+            if (httpCode < 200 || httpCode >= 300) {
+                // Record error and log it
+                if (httpCode > 0) {
+                    lastErrorMessage.format("HTTP Error %d", httpCode);
+                    String response = http.getString();
+                    debugLog("OpenTelemetry trace send failed: HTTP error %d: %s", httpCode, lastErrorMessage.c_str());
+                    debugLog("Response: %s", response.c_str());
+                } else {
+                    lastErrorMessage = http.errorToString(httpCode).c_str();
+                    debugLog("OpenTelemetry trace send failed: Connection error: %s (deadline %lu ms)",
+                             lastErrorMessage.c_str(), (unsigned long)timeout);
+                }
+                
+                http.end();
+                
+                // Keep the batch for the next flush instead of losing it
+                requeueInFlightSpans();
+                return false;
             }
             
+            debugLog("OpenTelemetry traces sent successfully (HTTP %d)", httpCode);
+            debugLog("Response body: %s", http.getString().c_str());
             http.end();
-            return false;
+            
+            // The same encoded request goes to any extra collectors
+            if (fanout) {
+                fanout->dispatch('T', jsonBuffer, strlen(jsonBuffer));
+            }
+            
+            // Clean up spans that were sent; anything left goes out in the next request
+            removeSentSpans();
         }
+        
+        hasFlushDeadline = false;
+        return true;
     }
     
     bool sendMetrics() {
-        if (metricCount == 0) {
+        ExportScope exportScope(exportInProgress);
+        
+        if (metricCount == 0 && histogramCount == 0) {
             lastErrorMessage = "No metrics to send";
             debugLog("Cannot send metrics - No metrics in batch");
             return false;
@@ -863,6 +1566,7 @@ public:
             lastErrorMessage = "WiFi not connected";
             lastHttpCode = 0;
             debugLog("Cannot send metrics - WiFi not connected");
+            retainBatch();
             return false;
         }
         
@@ -873,6 +1577,25 @@ public:
             return false;
         }
         
+        bool success = postMetricsPayload();
+        
+        // Keep what could not be sent, otherwise the batch is dropped
+        if (success) {
+            sentMetricBatches++;
+        } else {
+            retainBatch();
+        }
+        
+        // Reset metrics count
+        metricCount = 0;
+        histogramCount = 0;
+        pendingMetricBytes = 0;
+        
+        return success;
+    }
+    
+    // POST the metrics payload in jsonBuffer
+    bool postMetricsPayload() {
         // Check if WiFi is still connected before sending
         if (WiFi.status() != WL_CONNECTED) {
             lastErrorMessage = "WiFi disconnected before send";
@@ -884,30 +1607,90 @@ public:
         // Send the HTTP request
         http.begin(metricsEndpoint);
         http.addHeader("Content-Type", "application/json");
-        http.setTimeout(10000); // Increase timeout to 10 seconds
+        addTraceHeaders(http);
+        uint32_t timeout = applyRequestTimeout(http, metricsRtt);
         
         debugLog("Sending metrics data (%d bytes)...", strlen(jsonBuffer));
+        writeCaptureRecord('M', jsonBuffer, strlen(jsonBuffer));
         unsigned long startTime = millis();
         lastHttpCode = http.POST(jsonBuffer);
         unsigned long sendTime = millis() - startTime;
+        noteRequestResult(metricsRtt, lastHttpCode, sendTime, timeout);
         
         if (lastHttpCode < 200 || lastHttpCode >= 300) {
-            lastErrorMessage = http.getString();
-            if (lastErrorMessage.length() == 0) {
-                lastErrorMessage = String("HTTP Error ") + lastHttpCode;
+            if (lastHttpCode > 0) {
+                lastErrorMessage = http.getString().c_str();
+            } else {
+                lastErrorMessage = http.errorToString(lastHttpCode).c_str();
+            }
+            if (lastErrorMessage.isEmpty()) {
+                lastErrorMessage.format("HTTP Error %d", lastHttpCode);
             }
-            debugLog("Failed to send metrics: HTTP %d (%lums): %s", 
-                    lastHttpCode, sendTime, lastErrorMessage.c_str());
+            debugLog("Failed to send metrics: HTTP %d (%lums, deadline %lums): %s", 
+                    lastHttpCode, sendTime, (unsigned long)timeout, lastErrorMessage.c_str());
         } else {
             lastErrorMessage = "None";
             debugLog("Metrics sent successfully in %lums (HTTP %d)", sendTime, lastHttpCode);
         }
         http.end();
         
-        // Reset metrics count
-        metricCount = 0;
+        bool success = lastHttpCode >= 200 && lastHttpCode < 300;
+        if (success && fanout) {
+            fanout->dispatch('M', jsonBuffer, strlen(jsonBuffer));
+        }
+        return success;
+    }
+    
+    // Upload what the retention store holds, coarsest tier first: after a long outage the
+    // hourly shape arrives before any detail. Sends at most maxRequests requests and stops
+    // at the first failure; whatever is left goes out after the next successful send.
+    bool sendRetainedMetrics(uint8_t maxRequests) {
+        if (!retention || retention->isEmpty()) {
+            return true;
+        }
+        
+        ExportScope exportScope(exportInProgress);
+        
+        for (uint8_t request = 0; request < maxRequests && !retention->isEmpty(); request++) {
+            size_t sent;
+            const char* tier;
+            if (retention->getCoarse().size() > 0) {
+                tier = "hourly";
+                sent = createRetainedPayload(retention->getCoarse(), RETENTION_COARSE_SECONDS,
+                                             &OpenTelemetry::encodeRetainedBucket);
+            } else if (retention->getFine().size() > 0) {
+                tier = "5 minute";
+                sent = createRetainedPayload(retention->getFine(), RETENTION_FINE_SECONDS,
+                                             &OpenTelemetry::encodeRetainedBucket);
+            } else {
+                tier = "raw";
+                sent = createRetainedPayload(retention->getRaw(), 0, &OpenTelemetry::encodeRetainedPoint);
+            }
+            
+            if (sent == 0) {
+                debugLog("Failed to create retained metrics payload");
+                return false;
+            }
+            
+            debugLog("Sending %u retained %s entries", (unsigned)sent, tier);
+            if (!postMetricsPayload()) {
+                return false;
+            }
+            
+            if (retention->getCoarse().size() > 0) {
+                retention->dropCoarse(sent);
+            } else if (retention->getFine().size() > 0) {
+                retention->dropFine(sent);
+            } else {
+                retention->dropRaw(sent);
+            }
+        }
         
-        return lastHttpCode >= 200 && lastHttpCode < 300;
+        return retention->isEmpty();
+    }
+    
+    bool hasRetainedMetrics() const {
+        return retention && !retention->isEmpty();
     }
     
     // Combined function to send both metrics and traces
@@ -940,7 +1723,7 @@ public:
         // Count completed spans and metrics
         int completedSpanCount = 0;
         for (uint8_t i = 0; i < spanCount; i++) {
-            if (!spans[i].isActive && spans[i].endTimeNanos > 0) {
+            if (isPendingSpan(spans[i])) {
                 completedSpanCount++;
             }
         }
@@ -948,7 +1731,7 @@ public:
         debugLog("Sending %d metrics with %d spans queued...", metricCount, completedSpanCount);
         
         // First send metrics
-        if (metricCount > 0) {
+        if (metricCount > 0 || histogramCount > 0) {
             metricsSuccess = sendMetrics();
             if (!metricsSuccess) {
                 debugLog("Failed to send metrics: %s", lastErrorMessage.c_str());
@@ -976,6 +1759,68 @@ public:
         return metricsSuccess && tracesSuccess;
     }
 
+    // Whether any completed span is waiting to be sent
+    bool hasPendingSpans() const {
+        for (uint8_t i = 0; i < spanCount; i++) {
+            if (isPendingSpan(spans[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Exact encoded bytes of completed spans waiting to be sent
+    uint32_t getPendingTraceBytes() const {
+        return pendingSpanBytes;
+    }
+    
+    // Exact encoded bytes of the metric points in the current batch
+    uint32_t getPendingMetricBytes() const {
+        return pendingMetricBytes;
+    }
+    
+    // Number of metric points waiting for the next sendMetrics()
+    uint8_t getMetricCount() const {
+        return metricCount;
+    }
+    
+    // Milliseconds the oldest pending span has been waiting (0 if none)
+    unsigned long getOldestPendingSpanAge() const {
+        unsigned long oldest = 0;
+        unsigned long now = millis();
+        for (uint8_t i = 0; i < spanCount; i++) {
+            if (isPendingSpan(spans[i])) {
+                oldest = max(oldest, now - spans[i].completedAtMillis);
+            }
+        }
+        return oldest;
+    }
+    
+    // Request that pending spans are flushed by the given millis() time at the latest
+    void setFlushDeadline(unsigned long deadlineMillis) {
+        if (!hasFlushDeadline || (long)(deadlineMillis - flushDeadline) < 0) {
+            flushDeadline = deadlineMillis;
+        }
+        hasFlushDeadline = true;
+    }
+    
+    // Whether the pending spans fill a whole request (the envelope needs the last eighth)
+    bool isTraceBatchFull() const {
+        return pendingSpanBytes >= OTEL_BATCH_FLUSH_BYTES - (OTEL_BATCH_FLUSH_BYTES / 8);
+    }
+    
+    // Batch processor trigger: true once a full request's worth of bytes is pending, the
+    // oldest pending span has reached OTEL_BATCH_MAX_AGE, or an explicit deadline has passed
+    bool shouldFlushTraces() const {
+        if (!hasPendingSpans()) {
+            return false;
+        }
+        
+        return isTraceBatchFull() ||
+               getOldestPendingSpanAge() >= OTEL_BATCH_MAX_AGE ||
+               (hasFlushDeadline && (long)(millis() - flushDeadline) >= 0);
+    }
+    
     const char* getLastError() {
         return lastErrorMessage.c_str();
     }
@@ -984,6 +1829,89 @@ public:
         return lastHttpCode;
     }
     
+    const RttEstimator& getMetricsRtt() const {
+        return metricsRtt;
+    }
+    
+    const RttEstimator& getTracesRtt() const {
+        return tracesRtt;
+    }
+    
+    // Metric batches the collector accepted since boot
+    uint32_t getSentMetricBatchCount() const {
+        return sentMetricBatches;
+    }
+    
+    // Requests to the collector given up at their deadline since boot
+    uint32_t getTimeoutCount() const {
+        return metricsRtt.getTimeoutCount() + tracesRtt.getTimeoutCount();
+    }
+    
+    // Most recently started span that is still active, or 0 if none
+    uint64_t getActiveSpanId() {
+        for (int i = (int)spanCount - 1; i >= 0; i--) {
+            if (spans[i].isActive && spans[i].spanId != 0) {
+                return spans[i].spanId;
+            }
+        }
+        return 0;
+    }
+    
+    // Format a W3C traceparent ("00-<trace-id>-<span-id>-01") for the given span,
+    // or for the active span when spanId is 0. Returns false if there is no such span.
+    bool formatTraceparent(char* buffer, size_t bufferSize, uint64_t spanId = 0) {
+        if (!buffer || bufferSize < 56) {
+            return false;
+        }
+        
+        if (spanId == 0) {
+            spanId = getActiveSpanId();
+            if (spanId == 0) {
+                return false;
+            }
+        }
+        
+        for (uint8_t i = 0; i < spanCount; i++) {
+            if (spans[i].spanId == spanId) {
+                snprintf(buffer, bufferSize, "00-%016llx%016llx-%016llx-01",
+                         (unsigned long long)spans[i].traceId[0],
+                         (unsigned long long)spans[i].traceId[1],
+                         (unsigned long long)spanId);
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    // Set the tracestate header value sent with traceparent (nullptr to omit it)
+    void setTraceState(const char* state) {
+        traceState = (state && strlen(state) > 0) ? state : nullptr;
+    }
+    
+    // Add traceparent/tracestate headers for the active span to an outgoing request
+    // Call after client.begin(); does nothing when no span is active
+    bool addTraceHeaders(HTTPClient& client) {
+        char traceparent[56];
+        if (!formatTraceparent(traceparent, sizeof(traceparent))) {
+            return false;
+        }
+        
+        client.addHeader("traceparent", traceparent);
+        if (traceState) {
+            client.addHeader("tracestate", traceState);
+        }
+#ifdef OTEL_DEBUG_VERBOSE
+        debugLog("Propagating traceparent %s", traceparent);
+#endif
+        return true;
+    }
+    
+    // Whether an export is currently running (spans started now are suppressed)
+    bool isExportInProgress() const {
+        return exportInProgress;
+    }
+    
     // Gets the current trace ID as a hex string
     void getCurrentTraceIdHex(char* buffer, size_t bufferSize) {
         if (!buffer || bufferSize < 33) {
@@ -1092,11 +2020,11 @@ public:
                         if (spans[i].attributes[j].isString) {
                             debugLog("  - %s = \"%s\"", 
                                   spans[i].attributes[j].key, 
-                                  spans[i].attributes[j].stringValue);
+                                  spans[i].attributes[j].text(spans[i].text));
                         } else {
                             debugLog("  - %s = %f", 
                                   spans[i].attributes[j].key, 
-                                  spans[i].attributes[j].doubleValue);
+                                  spans[i].attributes[j].numericValue.toDouble());
                         }
                     }
                     
@@ -1202,6 +2130,29 @@ public:
         }
     }
     
+    // Keep metric batches that fail to send in a tiered store instead of dropping them,
+    // or nullptr to stop. Upload them with sendRetainedMetrics() once sends succeed again.
+    // At most one batch is kept per `minInterval` ms (normally the send interval).
+    void setRetention(MetricRetention* store, unsigned long minInterval = 0) {
+        retention = store;
+        retentionInterval = minInterval;
+        debugLog("Metric retention %s", store ? "enabled" : "disabled");
+    }
+    
+    // Copy every request the primary collector accepts to the fan-out's extra collectors,
+    // or nullptr to stop. The request is encoded once; each destination retries on its own.
+    void setFanout(ExportFanout* destinations) {
+        fanout = destinations;
+        debugLog("Export fan-out %s", destinations ? "enabled" : "disabled");
+    }
+    
+    // Tee every encoded request into a capture stream (e.g. &Serial), or nullptr to stop
+    // The resulting log can be replayed against any OTLP endpoint with tools/otlp_replay
+    void setCaptureStream(Print* stream) {
+        captureStream = stream;
+        debugLog("Request capture %s", stream ? "enabled" : "disabled");
+    }
+    
     // Get current timestamp using the registered provider
     uint64_t getCurrentTimeNanos() {
         return timeProvider();
@@ -0,0 +1,133 @@
+#ifndef PROMETHEUS_SERVER_H
+#define PROMETHEUS_SERVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "debug.h"
+#include "opentelemetry.h"
+
+// Longest request line we bother to read - "GET /metrics HTTP/1.1" fits comfortably
+#define PROMETHEUS_MAX_REQUEST_LINE 64
+// How long a scraper gets to send its request before we drop the connection
+#define PROMETHEUS_REQUEST_TIMEOUT 2000
+// Most scrapes served per handleClient() call, so a burst of scrapers cannot stall loop()
+#define PROMETHEUS_MAX_CLIENTS_PER_CALL 4
+
+// Tiny pull endpoint that serves GET /metrics in the Prometheus text format.
+// Does nothing until a scraper connects; the response is streamed straight from the
+// OpenTelemetry instrument registry into the socket, so a scrape only needs stack memory.
+class PrometheusServer {
+private:
+    WiFiServer server;
+    OpenTelemetry& otel;
+    uint16_t port;
+    bool started;
+    uint32_t scrapeCount;
+
+    // Read one CRLF-terminated line into buffer (truncated if too long), false on timeout
+    bool readLine(WiFiClient& client, char* buffer, size_t bufferSize, unsigned long startTime) {
+        size_t length = 0;
+
+        while (millis() - startTime < PROMETHEUS_REQUEST_TIMEOUT) {
+            if (!client.available()) {
+                if (!client.connected()) {
+                    return false;
+                }
+                delay(1);
+                continue;
+            }
+
+            char c = (char)client.read();
+            if (c == '\n') {
+                buffer[length] = '\0';
+                return true;
+            }
+            if (c != '\r' && length < bufferSize - 1) {
+                buffer[length++] = c;
+            }
+        }
+
+        return false;
+    }
+
+    void sendStatus(WiFiClient& client, const char* status) {
+        client.print("HTTP/1.1 ");
+        client.print(status);
+        client.print("\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+    }
+
+    // Answer one connected scraper and close the connection, true if metrics were served
+    bool serveClient(WiFiClient& client) {
+        unsigned long startTime = millis();
+        char line[PROMETHEUS_MAX_REQUEST_LINE];
+
+        if (!readLine(client, line, sizeof(line), startTime)) {
+            debugLog("Prometheus scrape dropped: no request line");
+            client.stop();
+            return false;
+        }
+
+        bool isMetrics = strncmp(line, "GET /metrics ", 13) == 0 || strcmp(line, "GET /metrics") == 0;
+
+        // Skip the request headers - we do not need any of them
+        char header[PROMETHEUS_MAX_REQUEST_LINE];
+        while (readLine(client, header, sizeof(header), startTime) && header[0] != '\0') {
+        }
+
+        if (!isMetrics) {
+            sendStatus(client, "404 Not Found");
+            client.print("Only /metrics is served here\n");
+            client.stop();
+            return false;
+        }
+
+        client.print("HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Connection: close\r\n\r\n");
+        size_t series = otel.writePrometheusMetrics(client);
+        client.stop();
+
+        scrapeCount++;
+        debugLog("Prometheus scrape #%lu served %u series in %lu ms",
+                 (unsigned long)scrapeCount, (unsigned)series, millis() - startTime);
+        return true;
+    }
+
+public:
+    PrometheusServer(OpenTelemetry& telemetry, uint16_t listenPort)
+        : server(listenPort), otel(telemetry), port(listenPort), started(false), scrapeCount(0) {}
+
+    void begin() {
+        if (started) {
+            return;
+        }
+        server.begin();
+        started = true;
+        debugLog("Prometheus endpoint listening on port %u (/metrics)", port);
+    }
+
+    // Serve every pending scrape (up to PROMETHEUS_MAX_CLIENTS_PER_CALL) - call from loop();
+    // returns immediately when idle. Clients are answered one after another, and one that
+    // connects without sending a request holds the rest for up to PROMETHEUS_REQUEST_TIMEOUT.
+    bool handleClient() {
+        if (!started) {
+            return false;
+        }
+
+        bool served = false;
+        for (uint8_t i = 0; i < PROMETHEUS_MAX_CLIENTS_PER_CALL; i++) {
+            WiFiClient client = server.available();
+            if (!client) {
+                break;
+            }
+            served |= serveClient(client);
+        }
+        return served;
+    }
+
+    uint32_t getScrapeCount() const {
+        return scrapeCount;
+    }
+};
+
+#endif
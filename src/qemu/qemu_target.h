@@ -0,0 +1,238 @@
+#ifndef QEMU_TARGET_H
+#define QEMU_TARGET_H
+
+// Stand-ins for the hardware Espressif's QEMU esp32 machine does not have, used by the
+// [env:qemu] build (QEMU_TARGET). QEMU emulates the CPU, memory, timers and an OpenCores
+// Ethernet MAC, but no radio, no ENV III unit and no M5StickC peripherals. So:
+//   - the network is Ethernet, behind a WiFi-shaped object the sketch uses in place of WiFi
+//   - the sensors produce a scripted signal
+//   - light sleep is a watchdog-fed delay
+// Memory and cycle statistics are written to the serial port as "#QEMUSTAT" lines for
+// tools/qemu_harness, the same way capture records are.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <esp_eth.h>
+#include <esp_eth_netif_glue.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_task_wdt.h>
+#include <math.h>
+#include "debug.h"
+#include "sensor_profiles.h"
+
+#if !CONFIG_ETH_USE_OPENETH
+#error "QEMU_TARGET needs CONFIG_ETH_USE_OPENETH - build with the [env:qemu] environment"
+#endif
+
+#define QEMU_STAT_MARKER "#QEMUSTAT"
+
+// Period of the scripted sensor signal; short, so a few minutes of emulation see it change
+#ifndef QEMU_SENSOR_PERIOD
+#define QEMU_SENSOR_PERIOD 600000
+#endif
+// Signal strength reported for the emulated link
+#ifndef QEMU_RSSI
+#define QEMU_RSSI -55
+#endif
+
+// The OpenCores Ethernet MAC behind the subset of the WiFi API the sketch uses. The driver
+// is started by the first begin() and stays up; disconnect() and begin() only toggle whether
+// the link counts as connected, so the sketch's reconnect paths still run.
+class QemuNetwork {
+private:
+    esp_netif_t* netif;
+    esp_eth_handle_t eth;
+    volatile bool gotIp;
+    bool linkWanted;
+    bool sleep;
+    wifi_mode_t currentMode;
+    wifi_power_t txPower;
+
+    static void onEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+        QemuNetwork* network = (QemuNetwork*)arg;
+        if (base == IP_EVENT && id == IP_EVENT_ETH_GOT_IP) {
+            network->gotIp = true;
+        } else if (base == ETH_EVENT && id == ETHERNET_EVENT_DISCONNECTED) {
+            network->gotIp = false;
+        }
+    }
+
+    bool startDriver() {
+        esp_netif_init();
+        esp_event_loop_create_default();  // Already created by the Arduino core is fine
+
+        esp_netif_config_t netifConfig = ESP_NETIF_DEFAULT_ETH();
+        netif = esp_netif_new(&netifConfig);
+
+        eth_mac_config_t macConfig = ETH_MAC_DEFAULT_CONFIG();
+        eth_phy_config_t phyConfig = ETH_PHY_DEFAULT_CONFIG();
+        phyConfig.autonego_timeout_ms = 100;  // The emulated PHY has nothing to negotiate
+        esp_eth_mac_t* mac = esp_eth_mac_new_openeth(&macConfig);
+        esp_eth_phy_t* phy = esp_eth_phy_new_dp83848(&phyConfig);
+
+        esp_eth_config_t ethConfig = ETH_DEFAULT_CONFIG(mac, phy);
+        if (esp_eth_driver_install(&ethConfig, &eth) != ESP_OK) {
+            debugLog("QEMU: Ethernet driver install failed");
+            eth = nullptr;
+            return false;
+        }
+        esp_netif_attach(netif, esp_eth_new_netif_glue(eth));
+        esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, onEvent, this);
+        esp_event_handler_register(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, onEvent, this);
+        if (esp_eth_start(eth) != ESP_OK) {
+            debugLog("QEMU: Ethernet start failed");
+            return false;
+        }
+        debugLog("QEMU: OpenCores Ethernet started, waiting for DHCP");
+        return true;
+    }
+
+public:
+    QemuNetwork()
+        : netif(nullptr), eth(nullptr), gotIp(false), linkWanted(false), sleep(false), currentMode(WIFI_OFF),
+          txPower(WIFI_POWER_19_5dBm) {}
+
+    void begin(const char* ssid, const char* password) {
+        (void)ssid;
+        (void)password;
+        linkWanted = true;
+        if (!eth) {
+            startDriver();
+        }
+    }
+
+    wl_status_t status() const {
+        return linkWanted && gotIp ? WL_CONNECTED : WL_DISCONNECTED;
+    }
+
+    bool isConnected() const {
+        return status() == WL_CONNECTED;
+    }
+
+    bool disconnect(bool wifiOff = false, bool eraseAp = false) {
+        (void)wifiOff;
+        (void)eraseAp;
+        linkWanted = false;
+        return true;
+    }
+
+    bool mode(wifi_mode_t next) {
+        currentMode = next;
+        return true;
+    }
+
+    bool setSleep(bool enabled) {
+        sleep = enabled;
+        return true;
+    }
+
+    bool getSleep() const {
+        return sleep;
+    }
+
+    int8_t RSSI() const {
+        return isConnected() ? QEMU_RSSI : 0;
+    }
+
+    // The emulated link has one fixed access point, and transmit power only records the value
+    uint8_t* BSSID() const {
+        static uint8_t bssid[6] = {0x52, 0x55, 0x0a, 0x00, 0x02, 0x02};
+        return isConnected() ? bssid : nullptr;
+    }
+
+    String BSSIDstr() const {
+        return isConnected() ? String("52:55:0A:00:02:02") : String();
+    }
+
+    bool setTxPower(wifi_power_t power) {
+        txPower = power;
+        return true;
+    }
+
+    wifi_power_t getTxPower() const {
+        return txPower;
+    }
+
+    IPAddress localIP() const {
+        esp_netif_ip_info_t info;
+        if (!netif || esp_netif_get_ip_info(netif, &info) != ESP_OK) {
+            return IPAddress();
+        }
+        return IPAddress(info.ip.addr);
+    }
+};
+
+// Scripted ENV III readings: a slow cycle plus a little deterministic noise, so adaptive
+// sampling and dual prediction see something like a real room
+inline float qemuSensorSignal(float centre, float amplitude, float noise, uint32_t salt) {
+    static uint32_t state = 0x2545F491;
+    state = state * 1664525 + 1013904223 + salt;
+    float phase = 2.0f * (float)M_PI * (float)(millis() % QEMU_SENSOR_PERIOD) / QEMU_SENSOR_PERIOD;
+    float jitter = ((state >> 8) & 0xFFFF) / 65535.0f * 2.0f - 1.0f;
+    return centre + amplitude * sinf(phase) + noise * jitter;
+}
+
+// Same members as the Sht3xSensor driver the sketch uses
+class QemuSHT3X {
+public:
+    float cTemp = 0;
+    float humidity = 0;
+
+    bool begin(TwoWire* wire, uint8_t address) {
+        return true;
+    }
+
+    bool setHeater(bool on) {
+        return true;
+    }
+
+    bool update(Sht3xRepeatability repeatability) {
+        delay(sht3xConversionMs(repeatability));
+        cTemp = qemuSensorSignal(22.0f, 3.0f, 0.05f, 1);
+        humidity = qemuSensorSignal(45.0f, -8.0f, 0.3f, 2);
+        return true;
+    }
+};
+
+// Same members as the M5Unit-ENV QMP6988 class the sketch uses; pressure is in Pa
+class QemuQMP6988 {
+public:
+    float pressure = 0;
+
+    bool begin(TwoWire* wire, uint8_t address, uint8_t sda, uint8_t scl, uint32_t speed) {
+        return true;
+    }
+
+    void setOversamplingP(unsigned char oversampling) {}
+    void setOversamplingT(unsigned char oversampling) {}
+    void setFilter(unsigned char filter) {}
+    void setpPowermode(int mode) {}
+
+    bool update() {
+        pressure = qemuSensorSignal(101325.0f, 150.0f, 5.0f, 3);
+        return true;
+    }
+};
+
+// QEMU does not emulate light sleep; wait instead, feeding the watchdog the real sleep would pause
+inline void qemuLightSleep(uint32_t ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms) {
+        esp_task_wdt_reset();
+        unsigned long remaining = ms - (millis() - start);
+        delay(remaining < 1000 ? remaining : 1000);
+    }
+}
+
+// One "#QEMUSTAT <millis> <event> key=value..." line. Stack is the calling task's high-water mark.
+inline void qemuReportStats(const char* event, uint32_t cycles) {
+    Serial.printf("%s %lu %s cycles=%lu heap_free=%lu heap_min=%lu heap_largest=%lu stack_free=%lu\n",
+                  QEMU_STAT_MARKER, (unsigned long)millis(), event, (unsigned long)cycles,
+                  (unsigned long)esp_get_free_heap_size(), (unsigned long)esp_get_minimum_free_heap_size(),
+                  (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+                  (unsigned long)uxTaskGetStackHighWaterMark(NULL));
+}
+
+#endif
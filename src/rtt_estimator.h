@@ -0,0 +1,122 @@
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+#include <stdint.h>
+
+// Request deadlines never go below the floor, which leaves room for the AP to buffer a frame
+// while the modem sleeps, or above the ceiling, the fixed timeout the transport used before
+#ifndef OTEL_TIMEOUT_MIN
+#define OTEL_TIMEOUT_MIN 1000
+#endif
+#ifndef OTEL_TIMEOUT_MAX
+#define OTEL_TIMEOUT_MAX 10000
+#endif
+// Doublings of the deadline after consecutive timeouts. Every OTEL_TIMEOUT_PROBE_EVERY-th
+// consecutive timeout waits the full ceiling instead, so a collector that became slow for
+// good is still found.
+#ifndef OTEL_TIMEOUT_BACKOFF_LIMIT
+#define OTEL_TIMEOUT_BACKOFF_LIMIT 2
+#endif
+#ifndef OTEL_TIMEOUT_PROBE_EVERY
+#define OTEL_TIMEOUT_PROBE_EVERY 8
+#endif
+
+// Request deadline for one endpoint, TCP retransmission timer style (RFC 6298): smoothed
+// request time plus four times its mean deviation, in integer milliseconds with the usual
+// 1/8 and 1/4 gains. Every response counts as a sample, whatever its status. Until the first
+// one arrives the deadline is the ceiling. A timeout doubles the deadline until the next sample.
+class RttEstimator {
+private:
+    uint32_t srttScaled;        // Smoothed request time x 8
+    uint32_t rttvarScaled;      // Mean deviation x 4
+    bool hasSample;
+    uint8_t backoff;
+    uint16_t consecutiveTimeouts;
+    uint32_t samples;
+    uint32_t timeouts;
+
+public:
+    RttEstimator() : srttScaled(0), rttvarScaled(0), hasSample(false), backoff(0), consecutiveTimeouts(0),
+                     samples(0), timeouts(0) {}
+
+    void addSample(uint32_t rttMs) {
+        if (!hasSample) {
+            srttScaled = rttMs << 3;
+            rttvarScaled = rttMs << 1;
+            hasSample = true;
+        } else {
+            int32_t error = (int32_t)rttMs - (int32_t)(srttScaled >> 3);
+            srttScaled += error;
+            if (error < 0) {
+                error = -error;
+            }
+            rttvarScaled += error - (int32_t)(rttvarScaled >> 2);
+        }
+        backoff = 0;
+        consecutiveTimeouts = 0;
+        samples++;
+    }
+
+    void noteTimeout() {
+        if (backoff < OTEL_TIMEOUT_BACKOFF_LIMIT) {
+            backoff++;
+        }
+        consecutiveTimeouts++;
+        timeouts++;
+    }
+
+    // Deadline for the next request, used for both the connect and the response
+    uint32_t getTimeout() const {
+        if (!hasSample ||
+            (consecutiveTimeouts > 0 && consecutiveTimeouts % OTEL_TIMEOUT_PROBE_EVERY == 0)) {
+            return OTEL_TIMEOUT_MAX;
+        }
+        uint32_t timeout = (srttScaled >> 3) + rttvarScaled;
+        if (timeout < OTEL_TIMEOUT_MIN) {
+            timeout = OTEL_TIMEOUT_MIN;
+        }
+        timeout <<= backoff;
+        return timeout > OTEL_TIMEOUT_MAX ? OTEL_TIMEOUT_MAX : timeout;
+    }
+
+    uint32_t getSmoothedRtt() const {
+        return srttScaled >> 3;
+    }
+
+    uint32_t getRttVariation() const {
+        return rttvarScaled >> 2;
+    }
+
+    uint32_t getSampleCount() const {
+        return samples;
+    }
+
+    uint32_t getTimeoutCount() const {
+        return timeouts;
+    }
+};
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <HTTPClient.h>
+
+// Set the connect and response deadlines of `client` for the next request; returns the deadline
+inline uint32_t applyRequestTimeout(HTTPClient& client, const RttEstimator& rtt) {
+    uint32_t timeout = rtt.getTimeout();
+    client.setConnectTimeout((int32_t)timeout);
+    client.setTimeout((uint16_t)timeout);
+    return timeout;
+}
+
+// Feed the outcome of a request made with `timeout`. Failures that came back before the
+// deadline (refused, no route) say nothing about the collector's response time and are skipped.
+inline void noteRequestResult(RttEstimator& rtt, int httpCode, uint32_t elapsedMs, uint32_t timeout) {
+    if (httpCode > 0) {
+        rtt.addSample(elapsedMs);
+    } else if (httpCode == HTTPC_ERROR_READ_TIMEOUT || elapsedMs >= timeout) {
+        rtt.noteTimeout();
+    }
+}
+#endif
+
+#endif
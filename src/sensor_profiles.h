@@ -0,0 +1,222 @@
+#ifndef SENSOR_PROFILES_H
+#define SENSOR_PROFILES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Battery level below which the low power profile is used whatever the precision needs
+#ifndef SENSOR_LOW_BATTERY_LEVEL
+#define SENSOR_LOW_BATTERY_LEVEL 20
+#endif
+
+// SHT3X single-shot commands without clock stretching, and the datasheet's maximum
+// measurement duration for each repeatability
+enum Sht3xRepeatability {
+    SHT3X_REPEATABILITY_HIGH,
+    SHT3X_REPEATABILITY_MEDIUM,
+    SHT3X_REPEATABILITY_LOW
+};
+
+#define SHT3X_CMD_MEASURE_HIGH   0x2400
+#define SHT3X_CMD_MEASURE_MEDIUM 0x240B
+#define SHT3X_CMD_MEASURE_LOW    0x2416
+#define SHT3X_CMD_HEATER_ON      0x306D
+#define SHT3X_CMD_HEATER_OFF     0x3066
+#define SHT3X_CMD_SOFT_RESET     0x30A2
+
+inline uint16_t sht3xMeasureCommand(Sht3xRepeatability repeatability) {
+    switch (repeatability) {
+        case SHT3X_REPEATABILITY_HIGH: return SHT3X_CMD_MEASURE_HIGH;
+        case SHT3X_REPEATABILITY_MEDIUM: return SHT3X_CMD_MEASURE_MEDIUM;
+        default: return SHT3X_CMD_MEASURE_LOW;
+    }
+}
+
+inline uint8_t sht3xConversionMs(Sht3xRepeatability repeatability) {
+    switch (repeatability) {
+        case SHT3X_REPEATABILITY_HIGH: return 16;
+        case SHT3X_REPEATABILITY_MEDIUM: return 7;
+        default: return 5;
+    }
+}
+
+// CRC-8 over each 16-bit word the sensor sends (polynomial 0x31, initial value 0xFF)
+inline uint8_t sht3xCrc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Convert a 6-byte measurement (temperature word, CRC, humidity word, CRC); false if a CRC fails
+inline bool sht3xDecode(const uint8_t* data, float* temperature, float* humidity) {
+    if (sht3xCrc8(data, 2) != data[2] || sht3xCrc8(data + 3, 2) != data[5]) {
+        return false;
+    }
+    uint16_t rawTemperature = (uint16_t)((data[0] << 8) | data[1]);
+    uint16_t rawHumidity = (uint16_t)((data[3] << 8) | data[4]);
+    *temperature = -45.0f + 175.0f * rawTemperature / 65535.0f;
+    *humidity = 100.0f * rawHumidity / 65535.0f;
+    return true;
+}
+
+// QMP6988 register codes, the values of M5Unit-ENV's QMP6988_OVERSAMPLING_* and
+// QMP6988_FILTERCOEFF_* macros
+enum Qmp6988Oversampling {
+    QMP6988_OSR_1X = 1,
+    QMP6988_OSR_2X = 2,
+    QMP6988_OSR_4X = 3,
+    QMP6988_OSR_8X = 4,
+    QMP6988_OSR_16X = 5,
+    QMP6988_OSR_32X = 6
+};
+
+enum Qmp6988Filter {
+    QMP6988_IIR_OFF = 0,
+    QMP6988_IIR_4 = 2,
+    QMP6988_IIR_16 = 4
+};
+
+enum SensorProfileId {
+    SENSOR_PROFILE_HIGH_ACCURACY,
+    SENSOR_PROFILE_BALANCED,
+    SENSOR_PROFILE_LOW_POWER,
+    SENSOR_PROFILE_COUNT,
+    SENSOR_PROFILE_AUTO = SENSOR_PROFILE_COUNT   // Pick from the power state and exported precision
+};
+
+// How one set of readings is taken. Noise and cost figures are approximate, from the
+// datasheets' typical repeatability and supply current at 3.3 V.
+struct SensorProfile {
+    const char* name;
+    uint8_t qmpOversamplingP;
+    uint8_t qmpOversamplingT;
+    uint8_t qmpFilter;
+    bool qmpForced;               // One conversion per reading and sleep in between, instead of normal mode
+    Sht3xRepeatability shtRepeatability;
+    bool shtHeater;               // Biases temperature upward, so only for condensation recovery
+    uint8_t qmpConversionMs;      // One pressure and temperature conversion at these oversampling rates
+    uint16_t energyMicroJoules;   // Both sensors, per reading
+    float temperatureNoise;       // C
+    float humidityNoise;          // %RH
+    float pressureNoise;          // Pa
+};
+
+// Index by SensorProfileId, most accurate first. High accuracy runs the pressure sensor in
+// normal mode, converting continuously so the IIR filter has samples to work with; it is
+// meant for external power.
+static const SensorProfile SENSOR_PROFILES[SENSOR_PROFILE_COUNT] = {
+    {"high_accuracy", QMP6988_OSR_32X, QMP6988_OSR_4X, QMP6988_IIR_16, false,
+     SHT3X_REPEATABILITY_HIGH, false, 85, 212, 0.04f, 0.08f, 0.5f},
+    {"balanced", QMP6988_OSR_8X, QMP6988_OSR_1X, QMP6988_IIR_OFF, true,
+     SHT3X_REPEATABILITY_MEDIUM, false, 23, 65, 0.08f, 0.15f, 1.5f},
+    {"low_power", QMP6988_OSR_2X, QMP6988_OSR_1X, QMP6988_IIR_OFF, true,
+     SHT3X_REPEATABILITY_LOW, false, 9, 31, 0.15f, 0.25f, 4.0f},
+};
+
+inline const SensorProfile& getSensorProfile(SensorProfileId id) {
+    return SENSOR_PROFILES[id < SENSOR_PROFILE_COUNT ? id : SENSOR_PROFILE_BALANCED];
+}
+
+// Time one reading of both sensors spends converting
+inline uint16_t sensorProfileConversionMs(const SensorProfile& profile) {
+    return profile.qmpConversionMs + sht3xConversionMs(profile.shtRepeatability);
+}
+
+// Smallest change the exported series can show, in the sensors' units
+struct SensorPrecision {
+    float temperature;
+    float humidity;
+    float pressure;               // Pa
+};
+
+// External power gets full accuracy. On battery the cheapest profile whose noise stays within
+// the exported precision is used, or balanced if none does; a low battery forces low power.
+inline SensorProfileId selectSensorProfile(bool onBattery, int batteryLevel, const SensorPrecision& exported) {
+    if (!onBattery) {
+        return SENSOR_PROFILE_HIGH_ACCURACY;
+    }
+    if (batteryLevel >= 0 && batteryLevel < SENSOR_LOW_BATTERY_LEVEL) {
+        return SENSOR_PROFILE_LOW_POWER;
+    }
+    for (int id = SENSOR_PROFILE_COUNT - 1; id >= 0; id--) {
+        const SensorProfile& profile = SENSOR_PROFILES[id];
+        if (profile.temperatureNoise <= exported.temperature && profile.humidityNoise <= exported.humidity &&
+            profile.pressureNoise <= exported.pressure) {
+            return (SensorProfileId)id;
+        }
+    }
+    return SENSOR_PROFILE_BALANCED;
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <Wire.h>
+
+// SHT3X driver that issues the single-shot command for a profile's repeatability. The
+// M5Unit-ENV driver always measures at high repeatability with clock stretching and has no
+// heater control.
+class Sht3xSensor {
+private:
+    TwoWire* wire;
+    uint8_t address;
+    bool heaterOn;
+
+    bool command(uint16_t code) {
+        wire->beginTransmission(address);
+        wire->write((uint8_t)(code >> 8));
+        wire->write((uint8_t)(code & 0xFF));
+        return wire->endTransmission() == 0;
+    }
+
+public:
+    float cTemp = 0;
+    float humidity = 0;
+
+    Sht3xSensor() : wire(nullptr), address(0x44), heaterOn(false) {}
+
+    // Soft reset, which also turns the heater off; false if nothing acknowledges at the address
+    bool begin(TwoWire* bus, uint8_t i2cAddress) {
+        wire = bus;
+        address = i2cAddress;
+        if (!command(SHT3X_CMD_SOFT_RESET)) {
+            return false;
+        }
+        delay(2);
+        heaterOn = false;
+        return true;
+    }
+
+    bool setHeater(bool on) {
+        if (!wire || on == heaterOn) {
+            return wire != nullptr;
+        }
+        if (!command(on ? SHT3X_CMD_HEATER_ON : SHT3X_CMD_HEATER_OFF)) {
+            return false;
+        }
+        heaterOn = on;
+        return true;
+    }
+
+    bool update(Sht3xRepeatability repeatability) {
+        if (!wire || !command(sht3xMeasureCommand(repeatability))) {
+            return false;
+        }
+        delay(sht3xConversionMs(repeatability));
+        uint8_t data[6];
+        if (wire->requestFrom(address, (uint8_t)sizeof(data)) != sizeof(data)) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(data); i++) {
+            data[i] = (uint8_t)wire->read();
+        }
+        return sht3xDecode(data, &cTemp, &humidity);
+    }
+};
+#endif
+
+#endif
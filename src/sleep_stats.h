@@ -0,0 +1,219 @@
+#ifndef SLEEP_STATS_H
+#define SLEEP_STATS_H
+
+#include <stdint.h>
+#include "histogram.h"
+
+// Completed sleep episodes kept for inspection, newest overwriting oldest
+#ifndef SLEEP_EPISODE_SLOTS
+#define SLEEP_EPISODE_SLOTS 16
+#endif
+
+// What the radio did while the CPU slept
+enum SleepRadioMode {
+    SLEEP_RADIO_ACTIVE,           // Fully awake, connection kept
+    SLEEP_RADIO_MODEM,            // Modem sleep, connection kept
+    SLEEP_RADIO_OFF,              // Disconnected and switched off
+    SLEEP_RADIO_MODE_COUNT
+};
+
+enum SleepWakeCause {
+    SLEEP_WAKE_TIMER,
+    SLEEP_WAKE_BUTTON,
+    SLEEP_WAKE_OTHER,
+    SLEEP_WAKE_CAUSE_COUNT
+};
+
+inline const char* sleepRadioModeName(SleepRadioMode mode) {
+    switch (mode) {
+        case SLEEP_RADIO_ACTIVE: return "active";
+        case SLEEP_RADIO_MODEM: return "modem";
+        default: return "off";
+    }
+}
+
+inline const char* sleepWakeCauseName(SleepWakeCause cause) {
+    switch (cause) {
+        case SLEEP_WAKE_TIMER: return "timer";
+        case SLEEP_WAKE_BUTTON: return "button";
+        default: return "other";
+    }
+}
+
+// Reconnect time of an episode that did not need one, or whose reconnect is still running
+#define SLEEP_NO_RECONNECT UINT32_MAX
+
+struct SleepEpisode {
+    uint32_t startMillis;
+    uint32_t plannedMs;
+    uint32_t actualMs;
+    uint32_t reconnectMs;         // Radio restore to usable connectivity, or SLEEP_NO_RECONNECT
+    SleepRadioMode radioMode;
+    SleepWakeCause cause;
+};
+
+// Bucket bounds in ms. Sleeps are capped at 30 s by the loop. Reconnects run from well under
+// a second for modem sleep to several seconds for a full association and DHCP.
+static const uint32_t SLEEP_DURATION_BOUNDS[] = {500, 1000, 2000, 3000, 5000, 10000, 20000, 30000};
+static const uint32_t SLEEP_RECONNECT_BOUNDS[] = {50, 100, 250, 500, 1000, 2000, 4000, 8000};
+
+// Records every light sleep: how long was planned, how long it lasted, why it ended, what the
+// radio did, and how long connectivity took to come back afterwards. Sleep durations are kept
+// per wake cause and reconnect times per radio mode as cumulative histograms. Duty cycle and
+// the share of planned sleep actually slept are kept per window, which the caller restarts
+// at every export. Pure bookkeeping on caller-supplied millis(), so it runs on the host too.
+class SleepTracker {
+private:
+    SleepEpisode episodes[SLEEP_EPISODE_SLOTS];
+    uint8_t next;
+    uint8_t stored;
+    SleepEpisode current;
+    bool sleeping;
+
+    uint32_t reconnectStart;
+    SleepRadioMode reconnectMode;
+    bool reconnecting;
+
+    uint32_t windowStart;
+    uint32_t windowAsleep;
+    uint32_t windowPlanned;
+
+    Histogram durations[SLEEP_WAKE_CAUSE_COUNT];
+    Histogram reconnects[SLEEP_RADIO_MODE_COUNT];
+    uint32_t durationsExported[SLEEP_WAKE_CAUSE_COUNT];
+    uint32_t reconnectsExported[SLEEP_RADIO_MODE_COUNT];
+
+    SleepEpisode* latest() {
+        return stored > 0 ? &episodes[(next + SLEEP_EPISODE_SLOTS - 1) % SLEEP_EPISODE_SLOTS] : nullptr;
+    }
+
+public:
+    SleepTracker() : next(0), stored(0), sleeping(false), reconnectStart(0), reconnectMode(SLEEP_RADIO_OFF),
+                     reconnecting(false), windowStart(0), windowAsleep(0), windowPlanned(0) {
+        const uint8_t durationBounds = sizeof(SLEEP_DURATION_BOUNDS) / sizeof(SLEEP_DURATION_BOUNDS[0]);
+        const uint8_t reconnectBounds = sizeof(SLEEP_RECONNECT_BOUNDS) / sizeof(SLEEP_RECONNECT_BOUNDS[0]);
+        for (uint8_t i = 0; i < SLEEP_WAKE_CAUSE_COUNT; i++) {
+            durations[i] = Histogram(SLEEP_DURATION_BOUNDS, durationBounds);
+            durationsExported[i] = 0;
+        }
+        for (uint8_t i = 0; i < SLEEP_RADIO_MODE_COUNT; i++) {
+            reconnects[i] = Histogram(SLEEP_RECONNECT_BOUNDS, reconnectBounds);
+            reconnectsExported[i] = 0;
+        }
+    }
+
+    void beginSleep(uint32_t plannedMs, SleepRadioMode radioMode, uint32_t now) {
+        current.startMillis = now;
+        current.plannedMs = plannedMs;
+        current.actualMs = 0;
+        current.reconnectMs = SLEEP_NO_RECONNECT;
+        current.radioMode = radioMode;
+        current.cause = SLEEP_WAKE_OTHER;
+        sleeping = true;
+    }
+
+    // Close the episode begun by beginSleep(); returns it, or null if none was open
+    const SleepEpisode* endSleep(SleepWakeCause cause, uint32_t now) {
+        if (!sleeping) {
+            return nullptr;
+        }
+        sleeping = false;
+        current.actualMs = now - current.startMillis;
+        current.cause = cause;
+        durations[cause].record(current.actualMs);
+        windowAsleep += current.actualMs;
+        windowPlanned += current.plannedMs;
+
+        episodes[next] = current;
+        next = (next + 1) % SLEEP_EPISODE_SLOTS;
+        if (stored < SLEEP_EPISODE_SLOTS) {
+            stored++;
+        }
+        return latest();
+    }
+
+    // The radio is being brought back after sleeping in `radioMode`. Connectivity is usable
+    // once noteConnected() is called; a failed attempt simply keeps the clock running.
+    void beginReconnect(SleepRadioMode radioMode, uint32_t now) {
+        if (reconnecting) {
+            return;
+        }
+        reconnectStart = now;
+        reconnectMode = radioMode;
+        reconnecting = true;
+    }
+
+    bool isReconnecting() const {
+        return reconnecting;
+    }
+
+    // Connectivity is usable again; returns the reconnect time, or SLEEP_NO_RECONNECT if none was running.
+    // The time is also stored on the latest episode, the sleep it followed.
+    uint32_t noteConnected(uint32_t now) {
+        if (!reconnecting) {
+            return SLEEP_NO_RECONNECT;
+        }
+        reconnecting = false;
+        uint32_t elapsed = now - reconnectStart;
+        reconnects[reconnectMode].record(elapsed);
+        SleepEpisode* episode = latest();
+        if (episode) {
+            episode->reconnectMs = elapsed;
+        }
+        return elapsed;
+    }
+
+    // Percent of the window spent asleep
+    float getDutyCycle(uint32_t now) const {
+        uint32_t elapsed = now - windowStart;
+        return elapsed > 0 ? 100.0f * windowAsleep / elapsed : 0.0f;
+    }
+
+    // Percent of the sleep planned in the window that was actually slept; early wakes lower it
+    float getPlannedShare() const {
+        return windowPlanned > 0 ? 100.0f * windowAsleep / windowPlanned : 100.0f;
+    }
+
+    void resetWindow(uint32_t now) {
+        windowStart = now;
+        windowAsleep = 0;
+        windowPlanned = 0;
+    }
+
+    const Histogram& getDurationHistogram(SleepWakeCause cause) const {
+        return durations[cause];
+    }
+
+    const Histogram& getReconnectHistogram(SleepRadioMode radioMode) const {
+        return reconnects[radioMode];
+    }
+
+    // Histograms with samples the collector has not been sent yet
+    bool isDurationChanged(SleepWakeCause cause) const {
+        return durations[cause].count != durationsExported[cause];
+    }
+
+    bool isReconnectChanged(SleepRadioMode radioMode) const {
+        return reconnects[radioMode].count != reconnectsExported[radioMode];
+    }
+
+    void markExported() {
+        for (uint8_t i = 0; i < SLEEP_WAKE_CAUSE_COUNT; i++) {
+            durationsExported[i] = durations[i].count;
+        }
+        for (uint8_t i = 0; i < SLEEP_RADIO_MODE_COUNT; i++) {
+            reconnectsExported[i] = reconnects[i].count;
+        }
+    }
+
+    // Completed episodes, 0 being the newest
+    uint8_t getEpisodeCount() const {
+        return stored;
+    }
+
+    const SleepEpisode& getEpisode(uint8_t age) const {
+        return episodes[(next + SLEEP_EPISODE_SLOTS - 1 - age % SLEEP_EPISODE_SLOTS) % SLEEP_EPISODE_SLOTS];
+    }
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef TX_POWER_CONTROLLER_H
+#define TX_POWER_CONTROLLER_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Clean uploads at a level before the next one down is tried
+#ifndef TX_POWER_WINDOW
+#define TX_POWER_WINDOW 5
+#endif
+// Uploads slower than this (ms) are taken as a sign of retransmissions
+#ifndef TX_POWER_LATENCY_TARGET
+#define TX_POWER_LATENCY_TARGET 1500
+#endif
+// Lowest signal the AP is assumed to need from us (dBm). The link is taken to be symmetric, so
+// the AP hears us at about our RSSI minus the power we have taken off.
+#ifndef TX_POWER_MIN_RSSI
+#define TX_POWER_MIN_RSSI -65
+#endif
+// How far (dB) RSSI may dip below that before power goes back up; absorbs measurement noise
+#ifndef TX_POWER_HYSTERESIS
+#define TX_POWER_HYSTERESIS 3
+#endif
+// Longest wait, in windows, before probing below a level that failed again
+#ifndef TX_POWER_MAX_HOLD
+#define TX_POWER_MAX_HOLD 16
+#endif
+// Access points whose settled level is remembered
+#ifndef TX_POWER_BSSID_SLOTS
+#define TX_POWER_BSSID_SLOTS 4
+#endif
+
+// Transmit power levels in 0.25 dBm, the values of Arduino's wifi_power_t, highest first
+static const int8_t TX_POWER_LEVELS[] = {78, 76, 74, 68, 60, 52, 44, 34, 28, 20, 8};
+static const uint8_t TX_POWER_LEVEL_COUNT = sizeof(TX_POWER_LEVELS) / sizeof(TX_POWER_LEVELS[0]);
+
+// Transmit power controller. It starts at full power and steps down one level after every
+// window of clean uploads, as long as the link margin allows. A failed upload steps back up
+// two levels at once and a slow one a single level, and a drop in RSSI goes straight back to a
+// level with margin. After a failed or slow upload the controller waits before
+// probing lower again, and the wait doubles each time, so a level that keeps failing is
+// tried rarely. The last level that carried a whole window cleanly is remembered per BSSID,
+// so a device that reconnects to the same AP starts there. Pure logic on caller-supplied
+// results, so tools/txpower_sim runs it against a simulated link.
+class TxPowerController {
+private:
+    struct NetworkEntry {
+        uint8_t bssid[6];
+        uint8_t settled;          // Index into TX_POWER_LEVELS
+        uint8_t hold;             // Windows to wait after the next backoff
+        uint32_t lastUsed;
+        bool used;
+    };
+
+    NetworkEntry networks[TX_POWER_BSSID_SLOTS];
+    NetworkEntry* current;
+    uint8_t level;
+    uint8_t cleanUploads;
+    uint16_t holdUploads;         // Clean uploads left before probing lower is allowed
+    int16_t rssiAverage;          // 1/16 dB, smoothed over about four uploads
+    bool rssiValid;
+    uint32_t useCounter;
+    uint32_t stepsDown;
+    uint32_t backoffs;
+
+    // Lowest level at which the AP should still hear us with margin to spare
+    static uint8_t marginLevel(int rssi) {
+        uint8_t lowest = 0;
+        while (lowest + 1 < TX_POWER_LEVEL_COUNT &&
+               rssi - (TX_POWER_LEVELS[0] - TX_POWER_LEVELS[lowest + 1]) / 4 >= TX_POWER_MIN_RSSI) {
+            lowest++;
+        }
+        return lowest;
+    }
+
+    bool setLevel(uint8_t next) {
+        if (next == level) {
+            return false;
+        }
+        level = next;
+        return true;
+    }
+
+public:
+    TxPowerController() : current(nullptr), level(0), cleanUploads(0), holdUploads(0), rssiAverage(0),
+                          rssiValid(false), useCounter(0),
+                          stepsDown(0), backoffs(0) {
+        memset(networks, 0, sizeof(networks));
+    }
+
+    // Switch to the AP we are associated with (null if none), restoring its settled level.
+    // A new AP starts at full power and takes the least recently used slot.
+    bool selectNetwork(const uint8_t* bssid) {
+        if (!bssid) {
+            current = nullptr;
+            return false;
+        }
+        if (current && memcmp(current->bssid, bssid, 6) == 0) {
+            return false;
+        }
+
+        NetworkEntry* slot = &networks[0];
+        bool known = false;
+        for (uint8_t i = 0; i < TX_POWER_BSSID_SLOTS; i++) {
+            if (networks[i].used && memcmp(networks[i].bssid, bssid, 6) == 0) {
+                slot = &networks[i];
+                known = true;
+                break;
+            }
+            if (!networks[i].used || (slot->used && networks[i].lastUsed < slot->lastUsed)) {
+                slot = &networks[i];
+            }
+        }
+        if (!known) {
+            memcpy(slot->bssid, bssid, 6);
+            slot->settled = 0;
+            slot->hold = 0;
+            slot->used = true;
+        }
+        slot->lastUsed = ++useCounter;
+        current = slot;
+        cleanUploads = 0;
+        holdUploads = 0;
+        rssiValid = false;
+        return setLevel(slot->settled);
+    }
+
+    // Record the outcome of one upload and the RSSI measured after it (0 if not connected).
+    // `delivered` should be true whenever the radio got the request through, even if the
+    // collector rejected it. Returns true if the level changed.
+    bool noteUpload(bool delivered, uint32_t latencyMs, int rssi) {
+        if (rssi < 0 && !rssiValid) {
+            rssiAverage = (int16_t)(rssi * 16);
+            rssiValid = true;
+        } else if (rssi < 0) {
+            rssiAverage += (int16_t)((rssi * 16 - rssiAverage) / 4);
+        }
+        // Without a signal reading there is no margin to spend
+        rssi = rssiValid ? rssiAverage / 16 : TX_POWER_MIN_RSSI - TX_POWER_HYSTERESIS - 1;
+        uint8_t lowest = marginLevel(rssi);
+        if (!delivered || latencyMs > TX_POWER_LATENCY_TARGET) {
+            cleanUploads = 0;
+            uint8_t steps = delivered ? 1 : 2;
+            uint8_t next = level > steps ? level - steps : 0;
+            if (next > lowest) {
+                next = lowest;
+            }
+            uint8_t hold = 1;
+            if (current) {
+                hold = current->hold ? current->hold : 1;
+                current->hold = hold * 2 > TX_POWER_MAX_HOLD ? TX_POWER_MAX_HOLD : hold * 2;
+                if (current->settled > next) {
+                    current->settled = next;
+                }
+            }
+            holdUploads = (uint16_t)hold * TX_POWER_WINDOW;
+            backoffs++;
+            return setLevel(next);
+        }
+
+        // The signal dropped (we moved, or the AP did): go straight back to a level with margin
+        if (level > marginLevel(rssi + TX_POWER_HYSTERESIS)) {
+            cleanUploads = 0;
+            if (current && current->settled > lowest) {
+                current->settled = lowest;
+            }
+            return setLevel(lowest);
+        }
+
+        if (holdUploads > 0) {
+            holdUploads--;
+            return false;
+        }
+        if (++cleanUploads < TX_POWER_WINDOW) {
+            return false;
+        }
+        cleanUploads = 0;
+        if (current) {
+            current->settled = level;
+        }
+
+        if (level >= lowest) {
+            return false;
+        }
+        stepsDown++;
+        return setLevel(level + 1);
+    }
+
+    // Current level in 0.25 dBm, as wifi_power_t
+    int8_t getPower() const {
+        return TX_POWER_LEVELS[level];
+    }
+
+    float getPowerDbm() const {
+        return TX_POWER_LEVELS[level] / 4.0f;
+    }
+
+    uint8_t getLevelIndex() const {
+        return level;
+    }
+
+    uint32_t getStepsDown() const {
+        return stepsDown;
+    }
+
+    uint32_t getBackoffs() const {
+        return backoffs;
+    }
+};
+
+#endif
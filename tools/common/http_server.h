@@ -0,0 +1,94 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+// Minimal blocking HTTP/1.1 server helpers used by the host-side OTLP stand-ins.
+// One thread per connection; only Content-Length framing is supported, which is what the
+// device's HTTPClient sends.
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Listen on every IPv4 and IPv6 address; returns the socket, or -1 with errno set
+inline int listenOn(const std::string& port) {
+    int listener = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);  // Not inherited by child processes
+    if (listener < 0) {
+        return -1;
+    }
+    int off = 0;
+    int on = 1;
+    setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in6 address;
+    memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons((uint16_t)atoi(port.c_str()));
+    if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+// Read one request from a keep-alive connection. `buffer` carries bytes of the next request
+// between calls.
+inline bool readHttpRequest(int fd, std::string& buffer, std::string& path, std::string& body) {
+    char chunk[4096];
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+        if (got <= 0) {
+            return false;
+        }
+        buffer.append(chunk, got);
+    }
+
+    std::string headers = buffer.substr(0, headerEnd + 4);
+    buffer.erase(0, headerEnd + 4);
+
+    char target[256];
+    if (sscanf(headers.c_str(), "%*s %255s HTTP/", target) != 1) {
+        return false;
+    }
+    path = target;
+
+    std::string lower;
+    for (char ch : headers) {
+        lower += (char)tolower((unsigned char)ch);
+    }
+    size_t length = 0;
+    size_t at = lower.find("\r\ncontent-length:");
+    if (at != std::string::npos) {
+        length = strtoul(lower.c_str() + at + 17, nullptr, 10);
+    }
+
+    while (buffer.size() < length) {
+        ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+        if (got <= 0) {
+            return false;
+        }
+        buffer.append(chunk, got);
+    }
+    body = buffer.substr(0, length);
+    buffer.erase(0, length);
+    return true;
+}
+
+// Reply with an empty JSON object, which is all the device looks at besides the status
+inline void sendHttpResponse(int fd, int status) {
+    char response[160];
+    int length = snprintf(response, sizeof(response),
+                          "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n{}",
+                          status, status >= 200 && status < 300 ? "OK" : "Error");
+    send(fd, response, length, MSG_NOSIGNAL);
+}
+
+#endif
@@ -0,0 +1,298 @@
+#ifndef OTLP_HTTP_H
+#define OTLP_HTTP_H
+
+// Minimal blocking HTTP/1.1 client used by the host-side OTLP tools.
+// Plain POSIX sockets with keep-alive, so the tools build with nothing but a C++17 compiler.
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class HttpConnection {
+public:
+    HttpConnection(const std::string& host, const std::string& port, int timeoutMs = 10000)
+        : host(host), port(port), timeoutMs(timeoutMs), fd(-1) {}
+
+    ~HttpConnection() {
+        close();
+    }
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    bool connect() {
+        close();
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* result = nullptr;
+        int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+        if (rc != 0) {
+            error = std::string("resolve failed: ") + gai_strerror(rc);
+            return false;
+        }
+
+        for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                break;
+            }
+            ::close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(result);
+
+        if (fd < 0) {
+            error = "connect failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        timeval tv;
+        tv.tv_sec = timeoutMs / 1000;
+        tv.tv_usec = (timeoutMs % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        rx.clear();
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    // POST a body and return the HTTP status code, or -1 on a connection error.
+    // A dropped keep-alive connection is re-established once before giving up.
+    int post(const std::string& path, const char* body, size_t length,
+             const char* contentType = "application/json") {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            if (fd < 0 && !connect()) {
+                return -1;
+            }
+
+            char header[512];
+            int headerLength = snprintf(header, sizeof(header),
+                    "POST %s HTTP/1.1\r\n"
+                    "Host: %s:%s\r\n"
+                    "Content-Type: %s\r\n"
+                    "Content-Length: %zu\r\n"
+                    "Connection: keep-alive\r\n"
+                    "\r\n",
+                    path.c_str(), host.c_str(), port.c_str(), contentType, length);
+
+            int status = 0;
+            if (sendAll(header, headerLength) && sendAll(body, length) && readResponse(status)) {
+                return status;
+            }
+            close();
+        }
+        return -1;
+    }
+
+    // GET a path and return the HTTP status code (body in `body`), or -1 on a connection error
+    int get(const std::string& path, std::string& body) {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            if (fd < 0 && !connect()) {
+                return -1;
+            }
+
+            char header[512];
+            int headerLength = snprintf(header, sizeof(header),
+                    "GET %s HTTP/1.1\r\n"
+                    "Host: %s:%s\r\n"
+                    "Connection: keep-alive\r\n"
+                    "\r\n",
+                    path.c_str(), host.c_str(), port.c_str());
+
+            int status = 0;
+            body.clear();
+            if (sendAll(header, headerLength) && readResponse(status, &body)) {
+                return status;
+            }
+            close();
+        }
+        return -1;
+    }
+
+    const std::string& lastError() const {
+        return error;
+    }
+
+private:
+    std::string host;
+    std::string port;
+    int timeoutMs;
+    int fd;
+    std::string rx;
+    std::string error;
+
+    bool sendAll(const char* data, size_t length) {
+        while (length > 0) {
+            ssize_t sent = ::send(fd, data, length, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                error = "send failed: " + std::string(strerror(errno));
+                return false;
+            }
+            data += sent;
+            length -= sent;
+        }
+        return true;
+    }
+
+    // Make sure at least `needed` bytes are buffered
+    bool fill(size_t needed) {
+        char chunk[4096];
+        while (rx.size() < needed) {
+            ssize_t got = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (got <= 0) {
+                error = got == 0 ? "connection closed by peer" : "recv failed: " + std::string(strerror(errno));
+                return false;
+            }
+            rx.append(chunk, got);
+        }
+        return true;
+    }
+
+    // Read an unframed body up to the end of the stream
+    bool readUntilClosed(std::string* body) {
+        char chunk[4096];
+        for (;;) {
+            ssize_t got = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (got == 0) {
+                break;
+            }
+            if (got < 0) {
+                error = "recv failed: " + std::string(strerror(errno));
+                return false;
+            }
+            rx.append(chunk, got);
+        }
+        if (body) {
+            body->append(rx);
+        }
+        rx.clear();
+        return true;
+    }
+
+    // Read until the delimiter is buffered and return the offset just past it
+    bool fillUntil(const char* delimiter, size_t from, size_t& end) {
+        for (;;) {
+            size_t found = rx.find(delimiter, from);
+            if (found != std::string::npos) {
+                end = found + strlen(delimiter);
+                return true;
+            }
+            if (!fill(rx.size() + 1)) {
+                return false;
+            }
+        }
+    }
+
+    static bool headerEquals(const std::string& headers, const char* name, const char* value) {
+        std::string lower;
+        lower.reserve(headers.size());
+        for (char c : headers) {
+            lower += (char)tolower((unsigned char)c);
+        }
+        std::string needle = std::string("\r\n") + name + ": " + value;
+        return lower.find(needle) != std::string::npos;
+    }
+
+    static long headerNumber(const std::string& headers, const char* name) {
+        std::string lower;
+        lower.reserve(headers.size());
+        for (char c : headers) {
+            lower += (char)tolower((unsigned char)c);
+        }
+        size_t at = lower.find(std::string("\r\n") + name + ":");
+        if (at == std::string::npos) {
+            return -1;
+        }
+        return strtol(lower.c_str() + at + strlen(name) + 3, nullptr, 10);
+    }
+
+    // Read one response, leaving the connection ready for the next request.
+    // The body is appended to `body` when given, otherwise discarded.
+    bool readResponse(int& status, std::string* body = nullptr) {
+        size_t headerEnd = 0;
+        if (!fillUntil("\r\n\r\n", 0, headerEnd)) {
+            return false;
+        }
+
+        std::string headers = rx.substr(0, headerEnd);
+        rx.erase(0, headerEnd);
+
+        if (sscanf(headers.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+            error = "malformed status line";
+            return false;
+        }
+
+        bool closeAfter = headerEquals(headers, "connection", "close");
+
+        if (headerEquals(headers, "transfer-encoding", "chunked")) {
+            for (;;) {
+                size_t lineEnd = 0;
+                if (!fillUntil("\r\n", 0, lineEnd)) {
+                    return false;
+                }
+                size_t chunkSize = strtoul(rx.c_str(), nullptr, 16);
+                rx.erase(0, lineEnd);
+                if (!fill(chunkSize + 2)) {
+                    return false;
+                }
+                if (body) {
+                    body->append(rx, 0, chunkSize);
+                }
+                rx.erase(0, chunkSize + 2);
+                if (chunkSize == 0) {
+                    break;
+                }
+            }
+        } else {
+            long contentLength = headerNumber(headers, "content-length");
+            if (contentLength >= 0) {
+                if (!fill((size_t)contentLength)) {
+                    return false;
+                }
+                if (body) {
+                    body->append(rx, 0, contentLength);
+                }
+                rx.erase(0, contentLength);
+            } else {
+                // No framing - the body runs until the server closes the connection
+                if (!readUntilClosed(body)) {
+                    return false;
+                }
+                closeAfter = true;
+            }
+        }
+
+        if (closeAfter) {
+            close();
+        }
+        return true;
+    }
+};
+
+#endif // OTLP_HTTP_H
@@ -0,0 +1,204 @@
+// energy_model - estimate the average current of a long awake period with and without the
+// CPU governor (src/cpu_governor.h)
+//
+// The loop is modelled as the phases the firmware goes through: a 50 ms poll, periodic display
+// updates, and a sensor read plus export every send interval. Each phase is some CPU work
+// (cycles, so it runs faster at a higher clock) plus time spent waiting on a bus or the network
+// (fixed, whatever the clock). The same CpuGovernor the firmware uses picks the clock for each
+// phase against a simulated clock. Currents come from a per-frequency table of busy and idle
+// CPU current; the radio adds its own current while an export waits on the network.
+// The default table uses the ESP32 datasheet ranges for modem sleep (low end idle, high end busy).
+//
+// Build: g++ -O2 -std=c++17 -I../../src energy_model.cpp -o energy_model
+//
+// Examples:
+//     energy_model                                   # one hour awake, 30 s sends
+//     energy_model --send-interval 10000 --encode 8 --boost 160
+
+#include <getopt.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "cpu_governor.h"
+
+struct CurrentEntry {
+    uint16_t mhz;
+    double busyMa;
+    double idleMa;
+};
+
+static const CurrentEntry CURRENT_TABLE[] = {
+    {80, 31.0, 20.0},
+    {160, 44.0, 27.0},
+    {240, 68.0, 30.0},
+};
+
+struct Options {
+    double awakeSeconds = 3600;
+    uint32_t sendInterval = 30000;
+    uint32_t pollMs = 50;              // delay() at the end of every loop iteration
+    double pollMcycles = 0.2;          // Button, WiFi and timer checks per iteration
+    uint32_t uiInterval = 1000;        // Display refresh while the screen is on
+    double uiMcycles = 1.0;
+    double uiBusMs = 12;               // SPI transfer
+    double sensingMcycles = 0.2;
+    double sensingBusMs = 30;          // I2C reads, mostly waiting for conversions
+    double encodeMcycles = 4.0;        // Building and copying the payloads
+    double networkMs = 150;            // Waiting on the collector with the radio awake
+    double radioMa = 100;              // Added to the CPU current while waiting on the network
+    uint16_t lowMhz = CPU_LOW_MHZ;
+    uint16_t boostMhz = CPU_BOOST_MHZ;
+};
+
+// Simulated platform: the governor sets this clock and reads this time
+static uint16_t simulatedMhz = CPU_BOOST_MHZ;
+static double simulatedMicros = 0;
+
+static void setSimulatedFrequency(uint16_t mhz) {
+    simulatedMhz = mhz;
+}
+
+static uint32_t simulatedMillis() {
+    return (uint32_t)(simulatedMicros / 1000);
+}
+
+static const CurrentEntry& currentAt(uint16_t mhz) {
+    for (const CurrentEntry& entry : CURRENT_TABLE) {
+        if (entry.mhz == mhz) {
+            return entry;
+        }
+    }
+    fprintf(stderr, "no current figures for %u MHz\n", (unsigned)mhz);
+    exit(2);
+}
+
+struct Result {
+    double chargeMicroAmpSeconds = 0;  // mA x us, converted when reported
+    double seconds = 0;
+};
+
+// Advance the simulated clock, charging the time at the current clock frequency
+static void spend(Result& result, double micros, bool busy, double extraMa = 0) {
+    const CurrentEntry& current = currentAt(simulatedMhz);
+    result.chargeMicroAmpSeconds += micros * ((busy ? current.busyMa : current.idleMa) + extraMa);
+    simulatedMicros += micros;
+}
+
+static void work(Result& result, double mcycles) {
+    spend(result, mcycles / simulatedMhz * 1e6, true);
+}
+
+static Result simulate(const Options& options, bool governed) {
+    Result result;
+    simulatedMicros = 0;
+    simulatedMhz = options.boostMhz;
+
+    CpuGovernor governor(setSimulatedFrequency, simulatedMillis, options.lowMhz, options.boostMhz);
+    if (governed) {
+        governor.begin(options.boostMhz);
+    }
+
+    double end = options.awakeSeconds * 1e6;
+    double nextUi = 0;
+    double nextSend = 0;
+    while (simulatedMicros < end) {
+        work(result, options.pollMcycles);
+
+        if (simulatedMicros >= nextUi) {
+            CpuPhaseScope phase(governor, CPU_PHASE_UI);
+            work(result, options.uiMcycles);
+            spend(result, options.uiBusMs * 1000, true);
+            nextUi += options.uiInterval * 1000.0;
+        }
+
+        if (simulatedMicros >= nextSend) {
+            {
+                CpuPhaseScope phase(governor, CPU_PHASE_SENSING);
+                work(result, options.sensingMcycles);
+                spend(result, options.sensingBusMs * 1000, true);
+            }
+            {
+                CpuPhaseScope phase(governor, CPU_PHASE_EXPORT);
+                work(result, options.encodeMcycles);
+                spend(result, options.networkMs * 1000, false, options.radioMa);
+            }
+            nextSend += options.sendInterval * 1000.0;
+        }
+
+        spend(result, options.pollMs * 1000, false);
+    }
+
+    result.seconds = simulatedMicros / 1e6;
+    if (governed) {
+        for (uint8_t i = 0; i < governor.getLevelCount(); i++) {
+            uint16_t mhz = governor.getLevelFrequency(i);
+            printf("  governed: %4u MHz for %9.1f s\n", (unsigned)mhz, governor.getTimeAt(mhz) / 1000.0);
+        }
+        printf("  governed: %u clock switches\n", (unsigned)governor.getSwitchCount());
+    }
+    return result;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --awake S              length of the awake period (default 3600)\n"
+            "  --send-interval MS     time between exports (default 30000)\n"
+            "  --ui-interval MS       time between display refreshes (default 1000)\n"
+            "  --encode MCYCLES       CPU work per export in millions of cycles (default 4)\n"
+            "  --network MS           time an export waits on the collector (default 150)\n"
+            "  --low MHZ              governor low clock: 80, 160 or 240 (default %d)\n"
+            "  --boost MHZ            governor boost clock (default %d)\n",
+            argv0, CPU_LOW_MHZ, CPU_BOOST_MHZ);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    static const option longOptions[] = {
+        {"awake", required_argument, nullptr, 'a'},
+        {"send-interval", required_argument, nullptr, 's'},
+        {"ui-interval", required_argument, nullptr, 'u'},
+        {"encode", required_argument, nullptr, 'e'},
+        {"network", required_argument, nullptr, 'n'},
+        {"low", required_argument, nullptr, 'l'},
+        {"boost", required_argument, nullptr, 'b'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'a': opt.awakeSeconds = atof(optarg); break;
+            case 's': opt.sendInterval = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'u': opt.uiInterval = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'e': opt.encodeMcycles = atof(optarg); break;
+            case 'n': opt.networkMs = atof(optarg); break;
+            case 'l': opt.lowMhz = (uint16_t)atoi(optarg); break;
+            case 'b': opt.boostMhz = (uint16_t)atoi(optarg); break;
+            default: return false;
+        }
+    }
+    return optind == argc && opt.awakeSeconds > 0 && opt.sendInterval > 0 && opt.uiInterval > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    currentAt(options.lowMhz);
+    currentAt(options.boostMhz);
+
+    Result fixed = simulate(options, false);
+    Result governed = simulate(options, true);
+
+    double fixedMa = fixed.chargeMicroAmpSeconds / (fixed.seconds * 1e6);
+    double governedMa = governed.chargeMicroAmpSeconds / (governed.seconds * 1e6);
+    printf("fixed %u MHz:      %.2f mA average, %.2f mAh over %.0f s\n", (unsigned)options.boostMhz, fixedMa,
+           fixedMa * fixed.seconds / 3600, fixed.seconds);
+    printf("governed %u/%u MHz: %.2f mA average, %.2f mAh over %.0f s\n", (unsigned)options.lowMhz,
+           (unsigned)options.boostMhz, governedMa, governedMa * governed.seconds / 3600, governed.seconds);
+    printf("average current reduced by %.1f%%\n", 100.0 * (fixedMa - governedMa) / fixedMa);
+    return 0;
+}
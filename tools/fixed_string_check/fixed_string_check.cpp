@@ -0,0 +1,132 @@
+// fixed_string_check - check that FixedString (src/fixed_string.h) never touches the heap
+//
+// Global operator new/delete are replaced with counting versions. The check then runs the
+// string operations the firmware uses for its status and error text - error messages set
+// from literals and formatted from HTTP codes, copies from one error string to another,
+// the display's label/message cache and the dotted IP address - and fails if any of them
+// allocated. It also checks the contents, including truncation at the capacity.
+//
+// Build: g++ -O2 -std=c++17 -I../../src fixed_string_check.cpp -o fixed_string_check
+//
+// Examples:
+//     fixed_string_check                       # prints one line per failed check, exits 1 on failure
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "fixed_string.h"
+
+// Same capacity as OTEL_ERROR_MESSAGE_SIZE in src/opentelemetry.h
+static const size_t ERROR_MESSAGE_SIZE = 96;
+
+static size_t allocations = 0;
+static unsigned failures = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* block = malloc(size ? size : 1);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    free(block);
+}
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+// Last error as the library keeps it (OpenTelemetry::lastErrorMessage)
+static void errorMessages() {
+    FixedString<ERROR_MESSAGE_SIZE> lastError;
+    lastError = "None";
+    check(lastError == "None", "error message from a literal");
+
+    check(lastError.format("HTTP Error %d", 503), "formatted error fits");
+    check(lastError == "HTTP Error 503", "formatted error text");
+
+    // The sketch copies the library's message into its own lastOtelError
+    FixedString<ERROR_MESSAGE_SIZE> lastOtelError;
+    lastOtelError = lastError;
+    check(lastOtelError == lastError, "copy between error messages");
+
+    // A long collector response is cut at the capacity
+    char response[ERROR_MESSAGE_SIZE * 2];
+    memset(response, 'x', sizeof(response) - 1);
+    response[sizeof(response) - 1] = '\0';
+    check(!lastError.format("%s", response), "oversized format reports truncation");
+    check(lastError.length() == ERROR_MESSAGE_SIZE, "oversized format stops at capacity");
+    check(!lastError.append("more"), "append to a full string reports truncation");
+}
+
+// The display's status line cache (displayStatus() in the sketch)
+static void statusCache() {
+    static FixedString<16> lastLabels[5];
+    static FixedString<32> lastMessages[5];
+    const char* labels[] = {"WiFi", "OTel", "Sensors", "NTP", "Battery"};
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 5; i++) {
+            if (lastLabels[i] != labels[i]) {
+                lastLabels[i] = labels[i];
+                lastMessages[i].clear();
+            }
+            char message[32];
+            snprintf(message, sizeof(message), "ok after %d tries", round);
+            if (lastMessages[i] != message) {
+                lastMessages[i] = message;
+            }
+        }
+    }
+    check(lastLabels[2] == "Sensors", "status label cached");
+    check(lastMessages[4] == "ok after 2 tries", "status message cached");
+
+    FixedString<16> label("A label that is too long");
+    check(label.length() == 16, "constructor truncates at capacity");
+}
+
+// Dotted IP address as localIpString() formats it
+static void ipAddress() {
+    FixedString<15> ip;
+    check(ip.format("%u.%u.%u.%u", 255u, 255u, 255u, 255u), "longest IP address fits");
+    check(ip == "255.255.255.255", "IP address text");
+    check(ip.format("%u.%u.%u.%u", 192u, 168u, 1u, 80u) && ip == "192.168.1.80", "IP address reformatted");
+}
+
+int main() {
+    size_t before = allocations;
+
+    errorMessages();
+    statusCache();
+    ipAddress();
+
+    size_t allocated = allocations - before;
+    check(allocated == 0, "no heap allocations");
+    printf("allocations %zu\n", allocated);
+    printf("failed_checks %u\n", failures);
+    return failures == 0 ? 0 : 1;
+}
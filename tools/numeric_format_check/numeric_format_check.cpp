@@ -0,0 +1,180 @@
+// numeric_format_check - check that NumericValue (src/numeric_value.h) prints numbers exactly
+// like printf("%.2f")
+//
+// The encoders print floats with NumericValue::formatFixed2(), which uses integer math only.
+// Collectors, the reconstructor and the dual predictor all rely on that text being the same
+// as printf("%.2f") of the stored value. The check compares the two:
+//   - on every stride-th float bit pattern, both signs, plus halfway and boundary cases
+//   - on metric payloads encoded from a scripted sensor run, once with NumericValue and once
+//     with printf, which have to be byte-identical
+// Mismatches are printed (the first ten of each kind) and the tool exits 1.
+//
+// Build: g++ -O2 -std=c++17 -I../../src numeric_format_check.cpp -o numeric_format_check
+//
+// Examples:
+//     numeric_format_check                     # about 6.7 million floats
+//     numeric_format_check --stride 1          # every float (slow)
+
+#include <getopt.h>
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "numeric_value.h"
+
+struct Options {
+    uint32_t stride = 641;          // Step between tested float bit patterns
+    uint32_t readings = 100000;     // Sensor readings in the scripted payload run
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --stride N      test every Nth float bit pattern (default 641)\n"
+            "  --readings N    readings per metric in the payload run (default 100000)\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    static const option longOptions[] = {
+        {"stride", required_argument, nullptr, 's'},
+        {"readings", required_argument, nullptr, 'r'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 's': opt.stride = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'r': opt.readings = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            default: return false;
+        }
+    }
+
+    return optind == argc && opt.stride > 0;
+}
+
+static uint64_t mismatches = 0;
+
+// Compare one float; returns false on a mismatch
+static bool checkValue(float value) {
+    char expected[64];
+    char actual[NUMERIC_VALUE_TEXT_SIZE];
+    snprintf(expected, sizeof(expected), "%.2f", (double)value);
+    NumericValue(value).format(actual, sizeof(actual));
+    if (strcmp(expected, actual) == 0) {
+        return true;
+    }
+    if (mismatches++ < 10) {
+        printf("MISMATCH %.9g: printf %s, formatFixed2 %s\n", value, expected, actual);
+    }
+    return false;
+}
+
+static uint64_t sweep(uint32_t stride) {
+    uint64_t tested = 0;
+    for (uint64_t bits = 0; bits <= 0xFFFFFFFFULL; bits += stride) {
+        uint32_t pattern = (uint32_t)bits;
+        float value;
+        memcpy(&value, &pattern, sizeof(value));
+        checkValue(value);
+        tested++;
+    }
+    return tested;
+}
+
+// Values where rounding or the fixed-point range changes behaviour
+static uint64_t edgeCases() {
+    static const float values[] = {
+        0.0f, -0.0f, 0.004f, 0.005f, 0.015f, 0.025f, 0.125f, 0.375f, 1.005f, 2.675f,
+        -0.005f, -0.125f, 99.995f, 1e-30f, 16777216.0f, 21474835.0f, 21474836.0f, 1e10f,
+        INFINITY, -INFINITY, NAN,
+    };
+    uint64_t tested = 0;
+    for (float value : values) {
+        checkValue(value);
+        checkValue(nextafterf(value, INFINITY));
+        checkValue(nextafterf(value, -INFINITY));
+        tested += 3;
+    }
+    // Every exact quarter and eighth between -1000 and 1000 is a halfway case for %.2f
+    for (int eighths = -8000; eighths <= 8000; eighths++) {
+        checkValue(eighths / 8.0f);
+        tested++;
+    }
+    return tested;
+}
+
+// One gauge data point as the OTLP encoder writes it, with the value already formatted
+static void appendPoint(std::string& payload, const char* name, uint64_t nanos, const char* value) {
+    char point[256];
+    snprintf(point, sizeof(point),
+             "{\"name\":\"%s\",\"gauge\":{\"dataPoints\":[{\"timeUnixNano\":\"%" PRIu64 "\",\"asDouble\":%s}]}},",
+             name, nanos, value);
+    payload += point;
+}
+
+// Encode a scripted sensor run both ways and compare the payloads byte for byte
+static bool payloadsIdentical(uint32_t readings) {
+    std::string withNumericValue;
+    std::string withPrintf;
+    char text[64];
+    uint64_t nanos = 1700000000000000000ULL;
+    srand(1);
+
+    for (uint32_t i = 0; i < readings; i++, nanos += 30000000000ULL) {
+        double phase = i / 2880.0 * 2 * M_PI;   // One day per 2880 readings
+        float noise = (rand() % 2001 - 1000) / 10000.0f;
+        const struct {
+            const char* name;
+            float value;
+        } metrics[] = {
+            {"temperature", 21.0f + 4.0f * (float)sin(phase) + noise},
+            {"humidity", 55.0f + 15.0f * (float)cos(phase) + noise * 10},
+            {"pressure", (101325.0f + 800.0f * (float)sin(phase / 3) + noise * 100) / 100},
+            {"battery_voltage", (4100.0f - (i % 5000) * 0.2f) / 1000},
+            {"wifi.rssi", (float)(-40 - rand() % 50)},
+        };
+
+        for (const auto& metric : metrics) {
+            NumericValue(metric.value).format(text, sizeof(text));
+            appendPoint(withNumericValue, metric.name, nanos, text);
+            snprintf(text, sizeof(text), "%.2f", (double)metric.value);
+            appendPoint(withPrintf, metric.name, nanos, text);
+        }
+    }
+
+    if (withNumericValue == withPrintf) {
+        return true;
+    }
+    size_t at = 0;
+    while (withNumericValue[at] == withPrintf[at]) {
+        at++;
+    }
+    size_t from = at > 60 ? at - 60 : 0;
+    printf("PAYLOAD MISMATCH at byte %zu:\n  printf:       %.120s\n  NumericValue: %.120s\n", at,
+           withPrintf.c_str() + from, withNumericValue.c_str() + from);
+    return false;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    uint64_t tested = sweep(opt.stride) + edgeCases();
+    printf("values_tested %" PRIu64 "\n", tested);
+    printf("value_mismatches %" PRIu64 "\n", mismatches);
+
+    bool identical = payloadsIdentical(opt.readings);
+    printf("payload_points %" PRIu64 "\n", (uint64_t)opt.readings * 5);
+    printf("payload_identical %s\n", identical ? "yes" : "no");
+
+    return mismatches == 0 && identical ? 0 : 1;
+}
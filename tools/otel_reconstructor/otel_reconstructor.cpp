@@ -0,0 +1,263 @@
+// otel_reconstructor - stand-in OTLP/HTTP receiver that refills dual-predicted metrics
+//
+// With DUAL_PREDICTION_ENABLED the device only sends temperature, humidity and pressure when
+// a reading leaves the model it shares with this relay (src/dual_prediction.h). Point the
+// device at the relay instead of the collector. Every received point certifies that the
+// model held to within the error target since the previous one, so the relay fills that
+// stretch with model values every --step ms before forwarding the request upstream.
+// Traces and all other metrics are forwarded unchanged.
+//
+// --model and --keyframe must match DUAL_PREDICTION_MODEL and DUAL_PREDICTION_KEYFRAME_INTERVAL
+// on the device. A gap of two keyframe intervals means reports were lost and is left empty.
+//
+// Build: g++ -O2 -std=c++17 -pthread -I../common -I../../src otel_reconstructor.cpp -o otel_reconstructor
+//
+// Examples:
+//     otel_reconstructor --host 192.168.1.80                      # listen on 4319, forward to :4318
+//     otel_reconstructor --listen 4318 --host collector --step 5000 --model last
+
+#include <getopt.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dual_prediction.h"
+#include "http_server.h"
+#include "otlp_http.h"
+
+struct Options {
+    std::string listenPort = "4319";
+    std::string host = "127.0.0.1";
+    std::string port = "4318";
+    std::string identityKey = "service.name";
+    PredictionModel model = PREDICT_LINEAR_TREND;
+    uint32_t keyframeInterval = 900000;   // Must match DUAL_PREDICTION_KEYFRAME_INTERVAL
+    uint32_t step = 10000;                // Spacing of regenerated points
+    std::vector<std::string> metrics;     // Dual-predicted metric names
+};
+
+// Reconstruction state of every (device, metric) series seen so far
+class Reconstructor {
+public:
+    explicit Reconstructor(const Options& options) : options(options) {}
+
+    // Insert the regenerated points in front of each dual-predicted point of a metrics payload
+    std::string process(const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string device = resourceIdentity(payload);
+        std::string out;
+        out.reserve(payload.size() * 2);
+        size_t copied = 0;
+
+        static const char pointsMarker[] = "\"gauge\":{\"dataPoints\":[";
+        size_t pos = 0;
+        while ((pos = payload.find("{\"name\":\"", pos)) != std::string::npos) {
+            size_t nameStart = pos + 9;
+            size_t nameEnd = payload.find('"', nameStart);
+            if (nameEnd == std::string::npos) {
+                break;
+            }
+            std::string name = payload.substr(nameStart, nameEnd - nameStart);
+            pos = nameEnd;
+            if (!isPredicted(name) || payload.compare(nameEnd + 2, sizeof(pointsMarker) - 1, pointsMarker) != 0) {
+                continue;
+            }
+
+            size_t pointStart = nameEnd + 2 + sizeof(pointsMarker) - 1;
+            size_t time = payload.find("\"timeUnixNano\":\"", pointStart);
+            size_t value = payload.find("\"asDouble\":", pointStart);
+            if (time == std::string::npos || value == std::string::npos) {
+                break;
+            }
+            uint64_t timestamp = strtoull(payload.c_str() + time + 16, nullptr, 10);
+            float reported = strtof(payload.c_str() + value + 11, nullptr);
+
+            DualPredictor& predictor = series(device, name);
+            if (predictor.hasModel() && timestamp <= predictor.getLastReportNanos()) {
+                continue; // Backfilled from the device's retention store; the model has moved on
+            }
+            std::string filled;
+            fill(predictor, timestamp, filled);
+            predictor.noteReported(reported, timestamp);
+
+            out.append(payload, copied, pointStart - copied);
+            out += filled;
+            copied = pointStart;
+        }
+        out.append(payload, copied, std::string::npos);
+        return out;
+    }
+
+private:
+    const Options& options;
+    std::mutex mutex;
+    std::map<std::string, DualPredictor> state;
+
+    bool isPredicted(const std::string& name) const {
+        for (const std::string& metric : options.metrics) {
+            if (metric == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string resourceIdentity(const std::string& payload) const {
+        std::string needle = "{\"key\":\"" + options.identityKey + "\",\"value\":{\"stringValue\":\"";
+        size_t at = payload.find(needle);
+        if (at == std::string::npos) {
+            return std::string();
+        }
+        at += needle.size();
+        return payload.substr(at, payload.find('"', at) - at);
+    }
+
+    DualPredictor& series(const std::string& device, const std::string& name) {
+        std::string key = device + '\n' + name;
+        auto found = state.find(key);
+        if (found == state.end()) {
+            // The tolerance only matters on the device; here the model is only ever asked to predict
+            found = state.emplace(key, DualPredictor(options.model, 0, options.keyframeInterval)).first;
+        }
+        return found->second;
+    }
+
+    // Model values between the previous report and the one at `timestamp`, each followed by a comma
+    void fill(const DualPredictor& predictor, uint64_t timestamp, std::string& out) {
+        if (!predictor.hasModel() || timestamp <= predictor.getLastReportNanos()) {
+            return;
+        }
+        uint64_t last = predictor.getLastReportNanos();
+        if (timestamp - last >= 2 * predictor.getKeyframeIntervalNanos()) {
+            return; // A keyframe went missing; nothing is known about this stretch
+        }
+
+        uint64_t step = (uint64_t)options.step * 1000000ULL;
+        char point[128];
+        char value[NUMERIC_VALUE_TEXT_SIZE];
+        for (uint64_t t = last + step; t < timestamp; t += step) {
+            NumericValue::formatFixed2(value, sizeof(value), predictor.predict(t));
+            snprintf(point, sizeof(point), "{\"timeUnixNano\":\"%" PRIu64 "\",\"asDouble\":%s},", t, value);
+            out += point;
+        }
+    }
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --listen PORT          port to accept OTLP/HTTP on (default 4319)\n"
+            "  --host HOST            upstream collector host (default 127.0.0.1)\n"
+            "  --port PORT            upstream collector OTLP/HTTP port (default 4318)\n"
+            "  --model last|linear    prediction model (default linear)\n"
+            "  --keyframe MS          keyframe interval (default 900000)\n"
+            "  --step MS              spacing of regenerated points (default 10000)\n"
+            "  --metric NAME          dual-predicted metric, repeatable\n"
+            "                         (default temperature, humidity and pressure)\n"
+            "  --identity-key KEY     resource attribute that tells devices apart (default service.name)\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    static const option longOptions[] = {
+        {"listen", required_argument, nullptr, 'l'},
+        {"host", required_argument, nullptr, 'h'},
+        {"port", required_argument, nullptr, 'p'},
+        {"model", required_argument, nullptr, 'o'},
+        {"keyframe", required_argument, nullptr, 'k'},
+        {"step", required_argument, nullptr, 's'},
+        {"metric", required_argument, nullptr, 'm'},
+        {"identity-key", required_argument, nullptr, 'i'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'l': opt.listenPort = optarg; break;
+            case 'h': opt.host = optarg; break;
+            case 'p': opt.port = optarg; break;
+            case 'o':
+                if (strcmp(optarg, "last") == 0) {
+                    opt.model = PREDICT_LAST_VALUE;
+                } else if (strcmp(optarg, "linear") == 0) {
+                    opt.model = PREDICT_LINEAR_TREND;
+                } else {
+                    return false;
+                }
+                break;
+            case 'k': opt.keyframeInterval = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 's': opt.step = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'm': opt.metrics.push_back(optarg); break;
+            case 'i': opt.identityKey = optarg; break;
+            default: return false;
+        }
+    }
+
+    if (optind != argc || opt.keyframeInterval == 0 || opt.step == 0) {
+        return false;
+    }
+    if (opt.metrics.empty()) {
+        opt.metrics = {"temperature", "humidity", "pressure"};
+    }
+    return true;
+}
+
+// One thread per device connection, each with its own upstream connection
+static void serve(int fd, const Options& options, Reconstructor& reconstructor) {
+    HttpConnection upstream(options.host, options.port);
+    std::string buffer;
+    std::string path;
+    std::string body;
+
+    while (readHttpRequest(fd, buffer, path, body)) {
+        if (path.find("/v1/metrics") != std::string::npos) {
+            body = reconstructor.process(body);
+        }
+        int status = upstream.post(path, body.data(), body.size());
+        if (status < 0) {
+            fprintf(stderr, "upstream %s:%s: %s\n", options.host.c_str(), options.port.c_str(),
+                    upstream.lastError().c_str());
+            status = 502;
+        }
+        sendHttpResponse(fd, status);
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int listener = listenOn(options.listenPort);
+    if (listener < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    printf("Listening on port %s, forwarding to %s:%s (%s model, keyframe %" PRIu32 " ms, step %" PRIu32 " ms)\n",
+           options.listenPort.c_str(), options.host.c_str(), options.port.c_str(),
+           options.model == PREDICT_LINEAR_TREND ? "linear" : "last value", options.keyframeInterval,
+           options.step);
+
+    Reconstructor reconstructor(options);
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        std::thread(serve, fd, std::cref(options), std::ref(reconstructor)).detach();
+    }
+}
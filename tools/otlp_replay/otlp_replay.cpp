@@ -0,0 +1,371 @@
+// otlp_replay - re-send OTLP requests captured on a device to any OTLP/HTTP endpoint
+//
+// Capture: set OTEL_CAPTURE_ENABLED to true in config.h and log the serial port to a file,
+// e.g. `pio device monitor > capture.log`. Each request appears as one line:
+//     #OTLPCAP <millis> <M|T> <bytes> <json payload>
+// Debug output in between is ignored, so the raw monitor log can be used as-is.
+//
+// Build: g++ -O2 -std=c++17 -pthread -I../common otlp_replay.cpp -o otlp_replay
+//
+// Examples:
+//     otlp_replay --host 192.168.1.80 capture.log                  # real time, one device
+//     otlp_replay --host collector --speed 60 capture.log          # one hour of traffic per minute
+//     otlp_replay --host collector --max --fleet 500 --connections 16 --retime capture.log
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "otlp_http.h"
+
+// Must match OTEL_CAPTURE_MARKER in src/opentelemetry.h
+static const char CAPTURE_MARKER[] = "#OTLPCAP ";
+
+struct CaptureRecord {
+    uint64_t millis;        // Device uptime when the request was sent
+    uint64_t offset;        // Milliseconds since the first record, continued across reboots
+    char signal;            // 'M' for metrics, 'T' for traces
+    const char* payload;    // Points into the memory-mapped capture
+    size_t length;
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "4318";
+    std::string metricsPath = "/v1/metrics";
+    std::string tracesPath = "/v1/traces";
+    std::string identityKey = "service.name";
+    double speed = 1.0;         // Replay speed multiplier, ignored with maxSpeed
+    bool maxSpeed = false;
+    unsigned connections = 1;   // Parallel keep-alive connections (one worker thread each)
+    unsigned fleet = 1;         // Number of simulated devices
+    unsigned loops = 1;
+    bool retime = false;        // Shift payload timestamps so the newest one lands at replay start
+    const char* file = nullptr;
+};
+
+struct Stats {
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> latencyMicros{0};
+    std::atomic<uint64_t> maxLatencyMicros{0};
+    std::mutex errorMutex;
+    std::string lastError;
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options] capture.log\n"
+            "  --host HOST            collector host (default 127.0.0.1)\n"
+            "  --port PORT            collector OTLP/HTTP port (default 4318)\n"
+            "  --metrics-path PATH    default /v1/metrics\n"
+            "  --traces-path PATH     default /v1/traces\n"
+            "  --speed N              replay N times faster than captured (default 1)\n"
+            "  --max                  replay as fast as the collector accepts\n"
+            "  --connections N        parallel connections (default 1)\n"
+            "  --fleet N              multiply the capture into N devices (default 1)\n"
+            "  --identity-key KEY     resource attribute made unique per device (default service.name)\n"
+            "  --loops N              replay the capture N times (default 1)\n"
+            "  --retime               shift timestamps so data looks current\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    static const option longOptions[] = {
+        {"host", required_argument, nullptr, 'h'},
+        {"port", required_argument, nullptr, 'p'},
+        {"metrics-path", required_argument, nullptr, 'm'},
+        {"traces-path", required_argument, nullptr, 't'},
+        {"speed", required_argument, nullptr, 's'},
+        {"max", no_argument, nullptr, 'x'},
+        {"connections", required_argument, nullptr, 'c'},
+        {"fleet", required_argument, nullptr, 'f'},
+        {"identity-key", required_argument, nullptr, 'k'},
+        {"loops", required_argument, nullptr, 'l'},
+        {"retime", no_argument, nullptr, 'r'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'h': opt.host = optarg; break;
+            case 'p': opt.port = optarg; break;
+            case 'm': opt.metricsPath = optarg; break;
+            case 't': opt.tracesPath = optarg; break;
+            case 's': opt.speed = atof(optarg); break;
+            case 'x': opt.maxSpeed = true; break;
+            case 'c': opt.connections = (unsigned)atoi(optarg); break;
+            case 'f': opt.fleet = (unsigned)atoi(optarg); break;
+            case 'k': opt.identityKey = optarg; break;
+            case 'l': opt.loops = (unsigned)atoi(optarg); break;
+            case 'r': opt.retime = true; break;
+            default: return false;
+        }
+    }
+
+    if (optind != argc - 1 || opt.speed <= 0 || opt.connections == 0 || opt.fleet == 0 || opt.loops == 0) {
+        return false;
+    }
+    opt.file = argv[optind];
+    opt.connections = std::min(opt.connections, opt.fleet);
+    return true;
+}
+
+// Scan the mapped capture for record lines; payloads are referenced in place, not copied
+static std::vector<CaptureRecord> parseCapture(const char* data, size_t size) {
+    std::vector<CaptureRecord> records;
+    const size_t markerLength = strlen(CAPTURE_MARKER);
+    size_t pos = 0;
+
+    while (pos < size) {
+        const char* lineStart = data + pos;
+        const char* lineEnd = (const char*)memchr(lineStart, '\n', size - pos);
+        size_t lineLength = lineEnd ? (size_t)(lineEnd - lineStart) : size - pos;
+
+        if (lineLength > markerLength && memcmp(lineStart, CAPTURE_MARKER, markerLength) == 0) {
+            const char* p = lineStart + markerLength;
+            char* next = nullptr;
+            CaptureRecord record;
+            record.millis = strtoull(p, &next, 10);
+            if (next && *next == ' ' && (next[1] == 'M' || next[1] == 'T') && next[2] == ' ') {
+                record.signal = next[1];
+                record.length = strtoul(next + 3, &next, 10);
+                record.payload = next + 1;
+                if (*next == ' ' && record.payload + record.length <= lineStart + lineLength) {
+                    records.push_back(record);
+                } else {
+                    fprintf(stderr, "warning: skipping truncated record at offset %zu\n", pos);
+                }
+            }
+        }
+
+        pos += lineLength + 1;
+    }
+
+    return records;
+}
+
+// Lay the records out on one timeline. Uptime restarts at zero when the device reboots
+// mid-capture; the downtime is unknown, so a new boot is placed right after the last record
+// before it, shifted by its own uptime. Returns the number of restarts found.
+static unsigned rebaseTimeline(std::vector<CaptureRecord>& records) {
+    unsigned restarts = 0;
+    uint64_t previousMillis = records.front().millis;
+    uint64_t previousOffset = 0;
+
+    for (CaptureRecord& record : records) {
+        if (record.millis >= previousMillis) {
+            record.offset = previousOffset + (record.millis - previousMillis);
+        } else {
+            record.offset = previousOffset + record.millis;
+            restarts++;
+        }
+        previousMillis = record.millis;
+        previousOffset = record.offset;
+    }
+    return restarts;
+}
+
+// Newest timestamp in the capture, used to shift everything to "now" with --retime
+static uint64_t newestTimestamp(const std::vector<CaptureRecord>& records) {
+    static const char key[] = "UnixNano\":\"";
+    uint64_t newest = 0;
+    for (const CaptureRecord& record : records) {
+        std::string body(record.payload, record.length);
+        for (size_t at = body.find(key); at != std::string::npos; at = body.find(key, at + 1)) {
+            newest = std::max<uint64_t>(newest, strtoull(body.c_str() + at + sizeof(key) - 1, nullptr, 10));
+        }
+    }
+    return newest;
+}
+
+// Give one simulated device its own identity, trace IDs and (optionally) current timestamps
+static void rewritePayload(const CaptureRecord& record, unsigned device, const Options& opt,
+                           uint64_t timeShiftNanos, std::string& out) {
+    out.assign(record.payload, record.length);
+
+    if (device > 0) {
+        std::string identity = "\"key\":\"" + opt.identityKey + "\",\"value\":{\"stringValue\":\"";
+        size_t at = out.find(identity);
+        if (at != std::string::npos) {
+            size_t valueEnd = out.find('"', at + identity.size());
+            if (valueEnd != std::string::npos) {
+                out.insert(valueEnd, "-" + std::to_string(device));
+            }
+        }
+
+        // Stamp the device number into the top of every trace ID so clones never share a trace
+        static const char traceKey[] = "\"traceId\":\"";
+        char prefix[9];
+        snprintf(prefix, sizeof(prefix), "%08x", device);
+        for (size_t t = out.find(traceKey); t != std::string::npos; t = out.find(traceKey, t + 1)) {
+            size_t idStart = t + sizeof(traceKey) - 1;
+            if (idStart + 8 <= out.size()) {
+                out.replace(idStart, 8, prefix);
+            }
+        }
+    }
+
+    if (timeShiftNanos > 0) {
+        static const char key[] = "UnixNano\":\"";
+        for (size_t at = out.find(key); at != std::string::npos; at = out.find(key, at + 1)) {
+            size_t digits = at + sizeof(key) - 1;
+            size_t digitsEnd = out.find('"', digits);
+            if (digitsEnd == std::string::npos) {
+                break;
+            }
+            uint64_t value = strtoull(out.c_str() + digits, nullptr, 10);
+            if (value > 0) {
+                out.replace(digits, digitsEnd - digits, std::to_string(value + timeShiftNanos));
+            }
+        }
+    }
+}
+
+static void runWorker(unsigned worker, const Options& opt, const std::vector<CaptureRecord>& records,
+                      uint64_t timeShiftNanos, Stats& stats) {
+    using Clock = std::chrono::steady_clock;
+    HttpConnection connection(opt.host, opt.port);
+    std::string body;
+
+    for (unsigned loop = 0; loop < opt.loops; loop++) {
+        Clock::time_point loopStart = Clock::now();
+        uint64_t loopShift = timeShiftNanos;
+        if (timeShiftNanos > 0) {
+            loopShift += (uint64_t)loop * (records.back().offset + 1) * 1000000ULL;
+        }
+
+        for (const CaptureRecord& record : records) {
+            if (!opt.maxSpeed) {
+                double offsetMicros = (double)record.offset * 1000.0 / opt.speed;
+                std::this_thread::sleep_until(loopStart + std::chrono::microseconds((int64_t)offsetMicros));
+            }
+
+            const std::string& path = record.signal == 'M' ? opt.metricsPath : opt.tracesPath;
+
+            // Devices are striped across workers so each connection carries an even share
+            for (unsigned device = worker; device < opt.fleet; device += opt.connections) {
+                const char* data = record.payload;
+                size_t length = record.length;
+                if (device > 0 || loopShift > 0) {
+                    rewritePayload(record, device, opt, loopShift, body);
+                    data = body.data();
+                    length = body.size();
+                }
+
+                Clock::time_point sendStart = Clock::now();
+                int status = connection.post(path, data, length);
+                uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sendStart).count();
+
+                if (status >= 200 && status < 300) {
+                    stats.sent++;
+                    stats.bytes += length;
+                    stats.latencyMicros += micros;
+                    uint64_t seen = stats.maxLatencyMicros.load();
+                    while (micros > seen && !stats.maxLatencyMicros.compare_exchange_weak(seen, micros)) {
+                    }
+                } else {
+                    stats.failed++;
+                    std::lock_guard<std::mutex> lock(stats.errorMutex);
+                    stats.lastError = status < 0 ? connection.lastError() : "HTTP " + std::to_string(status);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int fd = open(opt.file, O_RDONLY);
+    if (fd < 0) {
+        perror(opt.file);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable capture\n", opt.file);
+        close(fd);
+        return 1;
+    }
+    const char* data = (const char*)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    std::vector<CaptureRecord> records = parseCapture(data, st.st_size);
+    if (records.empty()) {
+        fprintf(stderr, "%s: no %s records found\n", opt.file, CAPTURE_MARKER);
+        return 1;
+    }
+    unsigned restarts = rebaseTimeline(records);
+    if (restarts > 0) {
+        fprintf(stderr, "warning: device uptime went backwards %u time(s) (reboot?); "
+                "each restart is replayed right after the request before it\n", restarts);
+    }
+
+    uint64_t timeShiftNanos = 0;
+    if (opt.retime) {
+        uint64_t newest = newestTimestamp(records);
+        uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        timeShiftNanos = newest > 0 && now > newest ? now - newest : 0;
+    }
+
+    char pace[32];
+    if (opt.maxSpeed) {
+        snprintf(pace, sizeof(pace), "maximum speed");
+    } else {
+        snprintf(pace, sizeof(pace), "%gx speed", opt.speed);
+    }
+    printf("Replaying %zu requests (%.1f s captured) as %u device(s) over %u connection(s) at %s\n",
+           records.size(), records.back().offset / 1000.0,
+           opt.fleet, opt.connections, pace);
+
+    Stats stats;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < opt.connections; w++) {
+        workers.emplace_back(runWorker, w, std::cref(opt), std::cref(records), timeShiftNanos, std::ref(stats));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t sent = stats.sent.load();
+    printf("Sent %" PRIu64 " requests (%" PRIu64 " failed), %.1f KB in %.2f s: %.1f req/s\n",
+           sent, stats.failed.load(), stats.bytes.load() / 1024.0, seconds, sent / std::max(seconds, 1e-9));
+    if (sent > 0) {
+        printf("Latency: avg %.2f ms, max %.2f ms\n",
+               stats.latencyMicros.load() / 1000.0 / sent, stats.maxLatencyMicros.load() / 1000.0);
+    }
+    if (stats.failed.load() > 0) {
+        printf("Last error: %s\n", stats.lastError.c_str());
+    }
+
+    munmap((void*)data, st.st_size);
+    return stats.failed.load() == 0 ? 0 : 1;
+}
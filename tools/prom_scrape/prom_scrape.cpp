@@ -0,0 +1,220 @@
+// prom_scrape - scrape the device's Prometheus endpoint from several scrapers at once and
+// check scrape latency and device memory
+//
+// Every scraper fetches /metrics on the same schedule, so their requests reach the device
+// together, the way several Prometheus servers (or one HA pair) would. The firmware answers
+// pending scrapes one after another, so the slowest scraper in each round shows the queueing.
+// Device memory is read from the heap gauge the firmware exports (FreeHeap by default). The
+// gauge only changes when the firmware takes a reading, so run for a few send intervals.
+//
+// The summary is printed as "key value" lines. With --max-latency or --min-heap the tool exits
+// 1 when a limit is crossed; it also exits 1 when a scrape fails.
+//
+// Build: g++ -O2 -std=c++17 -pthread -I../common prom_scrape.cpp -o prom_scrape
+//
+// Examples:
+//     prom_scrape --host 192.168.1.80                                   # 4 scrapers, 1 s apart
+//     prom_scrape --host 192.168.1.80 --scrapers 8 --duration 300 --max-latency 1500 --min-heap 60000
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "otlp_http.h"
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "9464";
+    std::string path = "/metrics";
+    std::string heapMetric = "FreeHeap";
+    unsigned scrapers = 4;          // Concurrent scrapers (one thread each)
+    unsigned intervalMs = 1000;     // Time between the starts of two scrape rounds
+    unsigned durationSeconds = 60;
+    unsigned maxLatencyMs = 0;      // Fail above this latency (0 = no limit)
+    unsigned minHeap = 0;           // Fail when the heap gauge drops below this (0 = no limit)
+};
+
+struct Results {
+    std::mutex mutex;
+    std::vector<double> latenciesMs;
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    double heapFirst = -1;
+    double heapMin = -1;
+    double heapLast = -1;
+    std::string lastError;
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --host HOST            device address (default 127.0.0.1)\n"
+            "  --port PORT            PROMETHEUS_PORT on the device (default 9464)\n"
+            "  --path PATH            default /metrics\n"
+            "  --scrapers N           concurrent scrapers (default 4)\n"
+            "  --interval MS          time between scrape rounds (default 1000)\n"
+            "  --duration S           how long to scrape (default 60)\n"
+            "  --heap-metric NAME     gauge holding the device's free heap (default FreeHeap)\n"
+            "  --max-latency MS       fail when a scrape takes longer\n"
+            "  --min-heap BYTES       fail when the free heap drops lower\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    static const option longOptions[] = {
+        {"host", required_argument, nullptr, 'h'},
+        {"port", required_argument, nullptr, 'p'},
+        {"path", required_argument, nullptr, 'u'},
+        {"scrapers", required_argument, nullptr, 's'},
+        {"interval", required_argument, nullptr, 'i'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"heap-metric", required_argument, nullptr, 'm'},
+        {"max-latency", required_argument, nullptr, 'l'},
+        {"min-heap", required_argument, nullptr, 'n'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'h': opt.host = optarg; break;
+            case 'p': opt.port = optarg; break;
+            case 'u': opt.path = optarg; break;
+            case 's': opt.scrapers = (unsigned)atoi(optarg); break;
+            case 'i': opt.intervalMs = (unsigned)atoi(optarg); break;
+            case 'd': opt.durationSeconds = (unsigned)atoi(optarg); break;
+            case 'm': opt.heapMetric = optarg; break;
+            case 'l': opt.maxLatencyMs = (unsigned)atoi(optarg); break;
+            case 'n': opt.minHeap = (unsigned)atoi(optarg); break;
+            default: return false;
+        }
+    }
+
+    return optind == argc && opt.scrapers > 0 && opt.intervalMs > 0 && opt.durationSeconds > 0;
+}
+
+// Value of the first sample of `metric` in a text exposition body, or -1 if it is missing
+static double sampleValue(const std::string& body, const std::string& metric) {
+    for (size_t line = 0; line < body.size(); ) {
+        size_t end = body.find('\n', line);
+        if (end == std::string::npos) {
+            end = body.size();
+        }
+        if (body.compare(line, metric.size(), metric) == 0 &&
+            (body[line + metric.size()] == '{' || body[line + metric.size()] == ' ')) {
+            size_t value = body.find("} ", line);
+            value = value != std::string::npos && value < end ? value + 2 : line + metric.size() + 1;
+            return strtod(body.c_str() + value, nullptr);
+        }
+        line = end + 1;
+    }
+    return -1;
+}
+
+static void runScraper(const Options& opt, std::chrono::steady_clock::time_point start, Results& results) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point stop = start + std::chrono::seconds(opt.durationSeconds);
+    std::string body;
+
+    for (Clock::time_point round = start; round < stop; round += std::chrono::milliseconds(opt.intervalMs)) {
+        std::this_thread::sleep_until(round);
+
+        // The device closes the connection after every scrape, so each round connects afresh
+        HttpConnection connection(opt.host, opt.port, std::max(opt.maxLatencyMs * 2, 10000u));
+        Clock::time_point sent = Clock::now();
+        int status = connection.get(opt.path, body);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - sent).count();
+
+        std::lock_guard<std::mutex> lock(results.mutex);
+        if (status != 200) {
+            results.failed++;
+            results.lastError = status < 0 ? connection.lastError() : "HTTP " + std::to_string(status);
+            continue;
+        }
+
+        results.latenciesMs.push_back(ms);
+        results.bytes += body.size();
+
+        double heap = sampleValue(body, opt.heapMetric);
+        if (heap >= 0) {
+            if (results.heapFirst < 0) {
+                results.heapFirst = heap;
+            }
+            if (results.heapMin < 0 || heap < results.heapMin) {
+                results.heapMin = heap;
+            }
+            results.heapLast = heap;
+        }
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    fprintf(stderr, "Scraping http://%s:%s%s with %u scraper(s) every %u ms for %u s\n",
+            opt.host.c_str(), opt.port.c_str(), opt.path.c_str(), opt.scrapers, opt.intervalMs,
+            opt.durationSeconds);
+
+    Results results;
+    auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    std::vector<std::thread> scrapers;
+    for (unsigned s = 0; s < opt.scrapers; s++) {
+        scrapers.emplace_back(runScraper, std::cref(opt), start, std::ref(results));
+    }
+    for (std::thread& scraper : scrapers) {
+        scraper.join();
+    }
+
+    std::vector<double>& latencies = results.latenciesMs;
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("scrapes %zu\n", latencies.size());
+    printf("failed %" PRIu64 "\n", results.failed);
+    if (!latencies.empty()) {
+        printf("bytes_per_scrape %" PRIu64 "\n", results.bytes / latencies.size());
+        printf("latency_p50_ms %.1f\n", percentile(latencies, 0.50));
+        printf("latency_p95_ms %.1f\n", percentile(latencies, 0.95));
+        printf("latency_max_ms %.1f\n", latencies.back());
+    }
+    if (results.heapMin >= 0) {
+        printf("heap_first %.0f\n", results.heapFirst);
+        printf("heap_min %.0f\n", results.heapMin);
+        printf("heap_last %.0f\n", results.heapLast);
+    } else {
+        fprintf(stderr, "warning: no %s series in the responses\n", opt.heapMetric.c_str());
+    }
+    if (results.failed > 0) {
+        fprintf(stderr, "last error: %s\n", results.lastError.c_str());
+    }
+
+    fflush(stdout);
+
+    bool ok = results.failed == 0 && !latencies.empty();
+    if (opt.maxLatencyMs > 0 && !latencies.empty() && latencies.back() > opt.maxLatencyMs) {
+        fprintf(stderr, "FAIL latency_max_ms %.1f > %u\n", latencies.back(), opt.maxLatencyMs);
+        ok = false;
+    }
+    if (opt.minHeap > 0 && results.heapMin >= 0 && results.heapMin < opt.minHeap) {
+        fprintf(stderr, "FAIL heap_min %.0f < %u\n", results.heapMin, opt.minHeap);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+# PlatformIO post script for [env:qemu]: merge the bootloader, partition table and app into the
+# single 4 MB flash image qemu-system-xtensa boots from ($BUILD_DIR/qemu_flash.bin)
+Import("env")
+
+
+def merge_image(source, target, env):
+    image = env.subst("$BUILD_DIR/qemu_flash.bin")
+    command = ['"$PYTHONEXE"', '"$OBJCOPY"', "--chip", "esp32", "merge_bin",
+               "--fill-flash-size", "4MB", "-o", '"%s"' % image]
+    for offset, path in env.get("FLASH_EXTRA_IMAGES", []):
+        command += [offset, '"%s"' % path]
+    command += ["$ESP32_APP_OFFSET", '"$BUILD_DIR/${PROGNAME}.bin"']
+    env.Execute(env.VerboseAction(" ".join(command), "Building QEMU flash image %s" % image))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", merge_image)
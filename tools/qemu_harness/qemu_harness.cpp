@@ -0,0 +1,481 @@
+// qemu_harness - boot the firmware under Espressif's QEMU and check its memory and timing
+//
+// Build the emulator image first with `pio run -e qemu`, which writes
+// .pio/build/qemu/qemu_flash.bin. The harness then plays the collector. It listens on the
+// OTLP/HTTP and health check ports on this machine. QEMU's user-mode network is given the
+// collector's address (OTEL_HOST in config.h) as the host address, so the firmware connects to
+// the harness unchanged. A scenario file scripts what the collector does over time:
+//   <seconds> up             accept everything (HTTP 200)
+//   <seconds> down           drop every connection without a reply
+//   <seconds> error          reject everything (HTTP 503)
+//   <seconds> slow <ms>      accept, but only after a delay
+// Times are host seconds since QEMU started; without a scenario the collector stays up.
+//
+// The firmware writes a "#QEMUSTAT" line at boot and after every send, with heap, stack and
+// cycle counts. The harness prints a summary as "key value" lines. Given a baseline of
+// "key <= value" / "key >= value" lines it also checks them, and exits 1 when one is crossed.
+// A panic, watchdog reset or reboot (QEMU runs with -no-reboot) always fails the run.
+//
+// Build: g++ -O2 -std=c++17 -pthread -I../common qemu_harness.cpp -o qemu_harness
+//
+// Examples:
+//     qemu_harness --collector-ip 192.168.1.80 --image .pio/build/qemu/qemu_flash.bin
+//     qemu_harness --collector-ip 192.168.1.80 --image qemu_flash.bin --scenario outage.scenario
+//     qemu_harness --collector-ip 192.168.1.80 --image qemu_flash.bin --baseline qemu_baseline.txt
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http_server.h"
+
+enum CollectorMode { COLLECTOR_UP, COLLECTOR_DOWN, COLLECTOR_ERROR, COLLECTOR_SLOW };
+
+struct ScenarioStep {
+    double at;                  // Host seconds since QEMU started
+    CollectorMode mode;
+    uint32_t delayMs;           // COLLECTOR_SLOW only
+};
+
+struct Options {
+    std::string qemu = "qemu-system-xtensa";
+    std::string image;
+    std::string collectorIp;
+    std::string port = "4318";
+    std::string healthPort = "13133";
+    std::string scenario;
+    std::string baseline;
+    std::string firmware;       // App binary, only for its size
+    double duration = 300;
+    int icount = 3;             // Deterministic instruction counting makes cycle counts repeatable
+    bool verbose = false;
+};
+
+static const char STAT_MARKER[] = "#QEMUSTAT";
+
+static const char* const PANIC_MARKERS[] = {
+    "Guru Meditation Error",
+    "abort() was called",
+    "Stack canary watchpoint triggered",
+    "***ERROR*** A stack overflow",
+    "Task watchdog got triggered",
+    "CORRUPT HEAP",
+};
+
+// Stand-in collector: answers OTLP/HTTP and health checks according to the current scenario step
+class StandInCollector {
+public:
+    void setMode(CollectorMode next, uint32_t delayMs) {
+        mode = next;
+        delay = delayMs;
+    }
+
+    void serve(int fd) {
+        std::string buffer;
+        std::string path;
+        std::string body;
+        while (readHttpRequest(fd, buffer, path, body)) {
+            CollectorMode current = mode;
+            if (current == COLLECTOR_DOWN) {
+                count(path, "dropped");
+                break;
+            }
+            if (current == COLLECTOR_SLOW) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(delay.load()));
+            }
+            int status = current == COLLECTOR_ERROR ? 503 : 200;
+            count(path, status == 200 ? "requests" : "rejected");
+            if (status == 200 && path.find("/v1/") != std::string::npos) {
+                count(path, "bytes", body.size());
+            }
+            sendHttpResponse(fd, status);
+        }
+        close(fd);
+    }
+
+    std::map<std::string, uint64_t> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+private:
+    std::atomic<CollectorMode> mode{COLLECTOR_UP};
+    std::atomic<uint32_t> delay{0};
+    std::mutex mutex;
+    std::map<std::string, uint64_t> counters;
+
+    void count(const std::string& path, const char* what, uint64_t amount = 1) {
+        const char* signal = path.find("/v1/metrics") != std::string::npos  ? "metrics"
+                             : path.find("/v1/traces") != std::string::npos ? "traces"
+                                                                            : "health";
+        std::lock_guard<std::mutex> lock(mutex);
+        counters[std::string(signal) + "_" + what] += amount;
+    }
+};
+
+// Aggregates the firmware's #QEMUSTAT lines and crash markers
+class StatCollector {
+public:
+    void line(const std::string& text) {
+        for (const char* marker : PANIC_MARKERS) {
+            if (text.find(marker) != std::string::npos) {
+                values["panics"]++;
+                fprintf(stderr, "firmware: %s\n", text.c_str());
+            }
+        }
+
+        size_t at = text.find(STAT_MARKER);
+        if (at == std::string::npos) {
+            return;
+        }
+        std::istringstream fields(text.substr(at + sizeof(STAT_MARKER) - 1));
+        uint64_t millis = 0;
+        std::string event;
+        if (!(fields >> millis >> event)) {
+            return;
+        }
+        std::map<std::string, uint64_t> stat;
+        std::string field;
+        while (fields >> field) {
+            size_t equals = field.find('=');
+            if (equals != std::string::npos) {
+                stat[field.substr(0, equals)] = strtoull(field.c_str() + equals + 1, nullptr, 10);
+            }
+        }
+
+        if (event == "boot") {
+            values["boot_ms"] = millis;
+        } else if (event == "send" || event == "send_failed") {
+            values[event == "send" ? "sends" : "send_failures"]++;
+            if (event == "send") {
+                sendCycles += stat["cycles"];
+                values["send_cycles_max"] = std::max(values["send_cycles_max"], stat["cycles"]);
+                values["send_cycles_avg"] = sendCycles / values["sends"];
+            }
+        }
+        lowest("heap_min", stat, "heap_min");
+        lowest("heap_largest_min", stat, "heap_largest");
+        lowest("stack_free_min", stat, "stack_free");
+    }
+
+    std::map<std::string, uint64_t> values;
+
+private:
+    uint64_t sendCycles = 0;
+
+    void lowest(const char* key, std::map<std::string, uint64_t>& stat, const char* field) {
+        auto found = stat.find(field);
+        if (found == stat.end()) {
+            return;
+        }
+        auto current = values.find(key);
+        if (current == values.end() || found->second < current->second) {
+            values[key] = found->second;
+        }
+    }
+};
+
+static bool parseMode(const std::string& name, CollectorMode& mode) {
+    if (name == "up") {
+        mode = COLLECTOR_UP;
+    } else if (name == "down") {
+        mode = COLLECTOR_DOWN;
+    } else if (name == "error") {
+        mode = COLLECTOR_ERROR;
+    } else if (name == "slow") {
+        mode = COLLECTOR_SLOW;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool loadScenario(const std::string& path, std::vector<ScenarioStep>& steps) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        perror(path.c_str());
+        return false;
+    }
+    char line[256];
+    int number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        std::istringstream fields(line);
+        ScenarioStep step = {0, COLLECTOR_UP, 0};
+        std::string mode;
+        if (!(fields >> step.at) || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+        if (!(fields >> mode) || !parseMode(mode, step.mode) ||
+            (step.mode == COLLECTOR_SLOW && !(fields >> step.delayMs))) {
+            fprintf(stderr, "%s:%d: expected \"<seconds> up|down|error|slow <ms>\"\n", path.c_str(), number);
+            fclose(file);
+            return false;
+        }
+        steps.push_back(step);
+    }
+    fclose(file);
+    std::stable_sort(steps.begin(), steps.end(),
+                     [](const ScenarioStep& a, const ScenarioStep& b) { return a.at < b.at; });
+    return true;
+}
+
+// Check every "key <= value" / "key >= value" line; a key missing from the summary fails too
+static bool checkBaseline(const std::string& path, const std::map<std::string, uint64_t>& summary) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        perror(path.c_str());
+        return false;
+    }
+    bool passed = true;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char key[64];
+        char op[3];
+        unsigned long long limit;
+        if (line[strspn(line, " \t")] == '#' || sscanf(line, "%63s %2s %llu", key, op, &limit) != 3) {
+            continue;
+        }
+        auto found = summary.find(key);
+        uint64_t value = found == summary.end() ? 0 : found->second;
+        bool ok = found != summary.end() && (strcmp(op, "<=") == 0 ? value <= limit : value >= limit);
+        if (!ok) {
+            printf("FAIL %s %" PRIu64 " (limit %s %llu)\n", key, value, op, limit);
+            passed = false;
+        }
+    }
+    fclose(file);
+    return passed;
+}
+
+// QEMU user-mode network on the collector's /24, with the collector as the host address
+static std::string networkArgument(const Options& options) {
+    unsigned a, b, c, d;
+    sscanf(options.collectorIp.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d);
+    char net[160];
+    snprintf(net, sizeof(net), "user,model=open_eth,net=%u.%u.%u.0/24,host=%s,dns=%u.%u.%u.%u,dhcpstart=%u.%u.%u.%u",
+             a, b, c, options.collectorIp.c_str(), a, b, c, d == 3 ? 4 : 3, a, b, c, d >= 100 && d < 116 ? 200 : 100);
+    return net;
+}
+
+static pid_t startQemu(const Options& options, int& output) {
+    std::vector<std::string> args = {
+        options.qemu, "-nographic", "-machine", "esp32", "-no-reboot",
+        "-drive", "file=" + options.image + ",if=mtd,format=raw",
+        "-nic", networkArgument(options),
+    };
+    if (options.icount > 0) {
+        args.push_back("-icount");
+        args.push_back(std::to_string(options.icount));
+    }
+
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(pipeFds[1], STDOUT_FILENO);
+        dup2(pipeFds[1], STDERR_FILENO);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        std::vector<char*> argv;
+        for (std::string& arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        perror(options.qemu.c_str());
+        _exit(127);
+    }
+    close(pipeFds[1]);
+    output = pipeFds[0];
+    return pid;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --collector-ip IP --image FLASH.bin [options]\n"
+            "  --collector-ip IP      OTEL_HOST the firmware was built with\n"
+            "  --image FILE           4 MB flash image from `pio run -e qemu`\n"
+            "  --port PORT            OTLP/HTTP port, as OTEL_PORT (default 4318)\n"
+            "  --health-port PORT     health check port (default 13133)\n"
+            "  --scenario FILE        collector behaviour over time (default: always up)\n"
+            "  --duration S           host seconds to run the firmware for (default 300)\n"
+            "  --baseline FILE        limits to check the summary against\n"
+            "  --firmware FILE        app binary, to report its size\n"
+            "  --icount N             QEMU -icount shift, 0 for real-time (default 3)\n"
+            "  --qemu PATH            emulator binary (default qemu-system-xtensa)\n"
+            "  --verbose              echo the firmware's serial output\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    static const option longOptions[] = {
+        {"collector-ip", required_argument, nullptr, 'c'},
+        {"image", required_argument, nullptr, 'i'},
+        {"port", required_argument, nullptr, 'p'},
+        {"health-port", required_argument, nullptr, 'h'},
+        {"scenario", required_argument, nullptr, 's'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"baseline", required_argument, nullptr, 'b'},
+        {"firmware", required_argument, nullptr, 'f'},
+        {"icount", required_argument, nullptr, 'n'},
+        {"qemu", required_argument, nullptr, 'q'},
+        {"verbose", no_argument, nullptr, 'v'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'c': opt.collectorIp = optarg; break;
+            case 'i': opt.image = optarg; break;
+            case 'p': opt.port = optarg; break;
+            case 'h': opt.healthPort = optarg; break;
+            case 's': opt.scenario = optarg; break;
+            case 'd': opt.duration = atof(optarg); break;
+            case 'b': opt.baseline = optarg; break;
+            case 'f': opt.firmware = optarg; break;
+            case 'n': opt.icount = atoi(optarg); break;
+            case 'q': opt.qemu = optarg; break;
+            case 'v': opt.verbose = true; break;
+            default: return false;
+        }
+    }
+    unsigned octets[4];
+    return optind == argc && !opt.image.empty() && opt.duration > 0 &&
+           sscanf(opt.collectorIp.c_str(), "%u.%u.%u.%u", &octets[0], &octets[1], &octets[2], &octets[3]) == 4;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<ScenarioStep> steps;
+    if (!options.scenario.empty() && !loadScenario(options.scenario, steps)) {
+        return 2;
+    }
+
+    StandInCollector collector;
+    for (const std::string& port : {options.port, options.healthPort}) {
+        int listener = listenOn(port);
+        if (listener < 0) {
+            perror(("listen on " + port).c_str());
+            return 1;
+        }
+        std::thread([listener, &collector]() {
+            for (;;) {
+                int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0) {
+                    std::thread(&StandInCollector::serve, &collector, fd).detach();
+                }
+            }
+        }).detach();
+    }
+
+    int output = -1;
+    pid_t qemu = startQemu(options, output);
+    if (qemu < 0) {
+        return 1;
+    }
+    printf("QEMU started with collector %s:%s for %.0f s\n", options.collectorIp.c_str(), options.port.c_str(),
+           options.duration);
+
+    StatCollector stats;
+    auto started = std::chrono::steady_clock::now();
+    size_t nextStep = 0;
+    bool exited = false;
+    std::string pending;
+    for (;;) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        if (elapsed >= options.duration) {
+            break;
+        }
+        while (nextStep < steps.size() && steps[nextStep].at <= elapsed) {
+            const ScenarioStep& step = steps[nextStep++];
+            collector.setMode(step.mode, step.delayMs);
+            printf("%7.1f s: collector %s\n", elapsed,
+                   step.mode == COLLECTOR_UP ? "up" : step.mode == COLLECTOR_DOWN ? "down"
+                                                   : step.mode == COLLECTOR_ERROR ? "error" : "slow");
+        }
+
+        pollfd pfd = {output, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        char chunk[4096];
+        ssize_t got = read(output, chunk, sizeof(chunk));
+        if (got <= 0) {
+            exited = true;
+            break;
+        }
+        pending.append(chunk, got);
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (options.verbose) {
+                printf("| %s\n", line.c_str());
+            }
+            stats.line(line);
+        }
+    }
+
+    if (!exited) {
+        kill(qemu, SIGTERM);
+    }
+    int status = 0;
+    waitpid(qemu, &status, 0);
+
+    // An exit before the deadline means the firmware reset (panic, watchdog or restart)
+    std::map<std::string, uint64_t> summary = stats.values;
+    summary["panics"] += 0;
+    summary["resets"] = exited ? 1 : 0;
+    for (const auto& counter : collector.snapshot()) {
+        summary[counter.first] = counter.second;
+    }
+    struct stat firmware;
+    if (!options.firmware.empty() && stat(options.firmware.c_str(), &firmware) == 0) {
+        summary["app_bytes"] = (uint64_t)firmware.st_size;
+    }
+
+    for (const auto& entry : summary) {
+        printf("%s %" PRIu64 "\n", entry.first.c_str(), entry.second);
+    }
+
+    bool passed = summary["panics"] == 0 && summary["resets"] == 0;
+    if (!passed) {
+        printf("FAIL firmware crashed or reset\n");
+    }
+    if (!options.baseline.empty() && !checkBaseline(options.baseline, summary)) {
+        passed = false;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,247 @@
+// sampling_sim - replay a recorded sensor series through the device's AdaptiveSampler and
+// report how many readings it takes and how far the held value strays from the signal
+//
+// Input is either a CSV of "<millis>,<value>" lines, or a capture log from the device
+// (OTEL_CAPTURE_ENABLED) together with --metric to pick the series out of the OTLP payloads.
+// Between recorded points the signal is interpolated linearly; the device is assumed to hold
+// its last reading until the next one, and the error is measured once per second.
+//
+// Build: g++ -O2 -std=c++17 -I../../src sampling_sim.cpp -o sampling_sim
+//
+// Examples:
+//     sampling_sim --min 10000 --max 600000 --target 0.1 temperature.csv
+//     sampling_sim --metric pressure --target 0.1 --fixed 30000 capture.log
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "adaptive_sampler.h"
+
+// Must match OTEL_CAPTURE_MARKER in src/opentelemetry.h
+static const char CAPTURE_MARKER[] = "#OTLPCAP ";
+
+struct Point {
+    double millis;
+    double value;
+};
+
+struct Options {
+    uint32_t minInterval = 10000;
+    uint32_t maxInterval = 600000;
+    float target = 0.1f;
+    uint32_t fixedInterval = 0;     // Baseline to compare against (default: minInterval)
+    const char* metric = nullptr;   // Read a capture log instead of CSV
+    const char* file = nullptr;
+};
+
+struct Result {
+    uint32_t samples = 0;
+    double maxError = 0;
+    double sumError = 0;
+    uint64_t checks = 0;
+    uint64_t withinTarget = 0;
+    std::vector<double> errors;
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options] <series.csv | capture.log>\n"
+            "  --min MS        shortest sampling interval (default 10000)\n"
+            "  --max MS        longest sampling interval (default 600000)\n"
+            "  --target X      error target in the metric's units (default 0.1)\n"
+            "  --fixed MS      fixed-rate baseline interval (default: --min)\n"
+            "  --metric NAME   read NAME from a device capture log instead of CSV\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    static const struct option longOptions[] = {
+        {"min", required_argument, nullptr, 'n'},
+        {"max", required_argument, nullptr, 'x'},
+        {"target", required_argument, nullptr, 't'},
+        {"fixed", required_argument, nullptr, 'f'},
+        {"metric", required_argument, nullptr, 'm'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'n': options.minInterval = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'x': options.maxInterval = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 't': options.target = strtof(optarg, nullptr); break;
+            case 'f': options.fixedInterval = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'm': options.metric = optarg; break;
+            default: return false;
+        }
+    }
+
+    if (optind != argc - 1 || options.minInterval == 0 || options.target <= 0) {
+        return false;
+    }
+    options.file = argv[optind];
+    if (options.fixedInterval == 0) {
+        options.fixedInterval = options.minInterval;
+    }
+    return true;
+}
+
+static void loadCsv(FILE* in, std::vector<Point>& series) {
+    char line[256];
+    while (fgets(line, sizeof(line), in)) {
+        Point point;
+        if (sscanf(line, "%lf,%lf", &point.millis, &point.value) == 2) {
+            series.push_back(point);
+        }
+    }
+}
+
+// Pull every data point of one metric out of the captured OTLP metric payloads
+static void loadCapture(FILE* in, const char* metric, std::vector<Point>& series) {
+    std::string needle = std::string("{\"name\":\"") + metric + "\",";
+    std::string line;
+    char chunk[4096];
+
+    while (fgets(chunk, sizeof(chunk), in)) {
+        line += chunk;
+        if (line.back() != '\n' && !feof(in)) {
+            continue; // Payload lines are longer than one chunk
+        }
+
+        if (line.compare(0, sizeof(CAPTURE_MARKER) - 1, CAPTURE_MARKER) == 0) {
+            size_t pos = 0;
+            while ((pos = line.find(needle, pos)) != std::string::npos) {
+                pos += needle.size();
+                size_t time = line.find("\"timeUnixNano\":\"", pos);
+                size_t value = line.find("\"asDouble\":", pos);
+                if (time == std::string::npos || value == std::string::npos) {
+                    break;
+                }
+                Point point;
+                point.millis = strtoull(line.c_str() + time + 16, nullptr, 10) / 1e6;
+                point.value = strtod(line.c_str() + value + 11, nullptr);
+                series.push_back(point);
+            }
+        }
+        line.clear();
+    }
+}
+
+// Linear interpolation of the recorded signal; cursor only moves forward
+static double signalAt(const std::vector<Point>& series, size_t& cursor, double millis) {
+    while (cursor + 1 < series.size() && series[cursor + 1].millis <= millis) {
+        cursor++;
+    }
+    if (cursor + 1 >= series.size()) {
+        return series.back().value;
+    }
+    const Point& a = series[cursor];
+    const Point& b = series[cursor + 1];
+    if (b.millis <= a.millis) {
+        return b.value;
+    }
+    return a.value + (b.value - a.value) * (millis - a.millis) / (b.millis - a.millis);
+}
+
+// Walk the series second by second, taking a reading whenever the policy says so
+template <typename Policy>
+static Result simulate(const std::vector<Point>& series, float target, Policy policy) {
+    Result result;
+    size_t cursor = 0;
+    double start = series.front().millis;
+    double end = series.back().millis;
+    double held = 0;
+
+    for (double now = start; now <= end; now += 1000.0) {
+        double truth = signalAt(series, cursor, now);
+        uint32_t elapsed = (uint32_t)(now - start);
+        if (policy(elapsed, (float)truth)) {
+            held = truth;
+            result.samples++;
+        }
+
+        double error = fabs(truth - held);
+        result.maxError = std::max(result.maxError, error);
+        result.sumError += error;
+        result.checks++;
+        result.withinTarget += error <= target ? 1 : 0;
+        result.errors.push_back(error);
+    }
+    return result;
+}
+
+static void report(const char* label, Result& result) {
+    std::sort(result.errors.begin(), result.errors.end());
+    double p99 = result.errors.empty() ? 0 : result.errors[(size_t)(result.errors.size() * 0.99)];
+    printf("%-9s %8" PRIu32 " readings  max error %.4f  mean %.4f  p99 %.4f  within target %.2f%%\n",
+           label, result.samples, result.maxError, result.checks ? result.sumError / result.checks : 0, p99,
+           result.checks ? 100.0 * result.withinTarget / result.checks : 0);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE* in = fopen(options.file, "r");
+    if (!in) {
+        perror(options.file);
+        return 1;
+    }
+    std::vector<Point> series;
+    if (options.metric) {
+        loadCapture(in, options.metric, series);
+    } else {
+        loadCsv(in, series);
+    }
+    fclose(in);
+
+    std::stable_sort(series.begin(), series.end(),
+                     [](const Point& a, const Point& b) { return a.millis < b.millis; });
+    if (series.size() < 2) {
+        fprintf(stderr, "%s: need at least two points, found %zu\n", options.file, series.size());
+        return 1;
+    }
+
+    double hours = (series.back().millis - series.front().millis) / 3600000.0;
+    printf("%zu recorded points over %.2f h; target %.4f, adaptive %" PRIu32 "-%" PRIu32 " ms, fixed %" PRIu32 " ms\n",
+           series.size(), hours, options.target, options.minInterval, options.maxInterval, options.fixedInterval);
+
+    AdaptiveSampler sampler(options.minInterval, options.maxInterval, options.target);
+    Result adaptive = simulate(series, options.target, [&](uint32_t now, float value) {
+        if (!sampler.isDue(now)) {
+            return false;
+        }
+        sampler.update(value, now);
+        return true;
+    });
+
+    uint32_t lastFixed = 0;
+    bool first = true;
+    Result fixed = simulate(series, options.target, [&](uint32_t now, float) {
+        if (!first && now - lastFixed < options.fixedInterval) {
+            return false;
+        }
+        first = false;
+        lastFixed = now;
+        return true;
+    });
+
+    report("adaptive", adaptive);
+    report("fixed", fixed);
+    if (adaptive.samples > 0) {
+        printf("adaptive takes %.1f%% of the fixed-rate readings\n", 100.0 * adaptive.samples / fixed.samples);
+    }
+    return 0;
+}
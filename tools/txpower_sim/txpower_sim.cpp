@@ -0,0 +1,213 @@
+// txpower_sim - run the device's TxPowerController (src/tx_power_controller.h) against a
+// simulated WiFi link and compare it with always transmitting at full power
+//
+// Each upload is a handful of frames. A frame reaches the AP with a probability that falls off
+// around the AP's sensitivity; the signal the AP sees is the downlink RSSI the device measures,
+// less the power taken off, plus slow fading that changes from upload to upload. A frame is
+// retried up to 7 times by the MAC; after that TCP retransmits it on a doubling timeout, and the
+// upload fails once it runs past the HTTP timeout. Transmit current follows the ESP32's roughly
+// linear rise with output power; the radio draws receive current for the rest of the upload.
+//
+// The device can be moved (--move-at) and can alternate between two access points
+// (--second-ap), to exercise the backoff and the per-BSSID memory.
+//
+// Build: g++ -O2 -std=c++17 -I../../src txpower_sim.cpp -o txpower_sim
+//
+// Examples:
+//     txpower_sim --rssi -45
+//     txpower_sim --rssi -50 --move-at 1000 --move-rssi -68
+//     txpower_sim --rssi -40 --second-ap -60 --switch-every 50
+
+#include <getopt.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "tx_power_controller.h"
+
+static const int MAC_ATTEMPTS = 7;
+
+struct Options {
+    uint32_t uploads = 2000;
+    double rssi = -45;               // What the device hears from the AP (dBm)
+    double sensitivity = -80;        // Uplink signal at which half the frames get through
+    double fade = 4;                 // Standard deviation of the slow fading (dB)
+    uint32_t frames = 6;             // Frames the device sends per upload
+    double airtimeMs = 0.5;          // Per transmission attempt
+    double rttMs = 150;              // Upload time on a clean link
+    double rtoMs = 300;              // First TCP retransmission timeout
+    double timeoutMs = 5000;         // HTTP timeout
+    double rxMa = 95;                // Radio current while not transmitting
+    uint32_t moveAt = 0;             // Upload after which the device is at --move-rssi
+    double moveRssi = -70;
+    double secondAp = 0;             // RSSI of a second AP, 0 for none
+    uint32_t switchEvery = 100;      // Uploads before switching access point
+    uint32_t seed = 1;
+};
+
+struct Result {
+    uint32_t delivered = 0;
+    uint32_t slow = 0;
+    uint32_t attempts = 0;
+    uint32_t levelChanges = 0;
+    double latencyMs = 0;
+    double chargeMaMs = 0;
+    double txChargeMaMs = 0;
+    double powerDbm = 0;
+};
+
+// ESP32 transmit current: about 240 mA at 19.5 dBm, falling roughly 6 mA per dBm
+static double txCurrentMa(double dbm) {
+    return 123 + 6 * dbm;
+}
+
+static Result simulate(const Options& options, bool controlled) {
+    Result result;
+    std::mt19937 random(options.seed);
+    std::normal_distribution<double> fading(0, options.fade);
+    std::normal_distribution<double> measurement(0, 2);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    TxPowerController controller;
+    static const uint8_t BSSIDS[2][6] = {{0x02, 0, 0, 0, 0, 1}, {0x02, 0, 0, 0, 0, 2}};
+    const double fullDbm = TX_POWER_LEVELS[0] / 4.0;
+
+    for (uint32_t upload = 0; upload < options.uploads; upload++) {
+        int ap = options.secondAp != 0 && (upload / options.switchEvery) % 2 == 1 ? 1 : 0;
+        double rssi = ap == 1 ? options.secondAp : options.rssi;
+        if (options.moveAt > 0 && upload >= options.moveAt) {
+            rssi += options.moveRssi - options.rssi;
+        }
+
+        uint8_t before = controller.getLevelIndex();
+        if (controlled) {
+            controller.selectNetwork(BSSIDS[ap]);
+        }
+        double dbm = controlled ? controller.getPowerDbm() : fullDbm;
+        double uplink = rssi - (fullDbm - dbm) + fading(random);
+        double frameLoss = 1 / (1 + exp((uplink - options.sensitivity) / 1.5));
+
+        uint32_t attempts = 0;
+        double latency = options.rttMs;
+        bool delivered = true;
+        for (uint32_t frame = 0; frame < options.frames && delivered; frame++) {
+            double rto = options.rtoMs;
+            bool sent = false;
+            while (!sent) {
+                for (int attempt = 0; attempt < MAC_ATTEMPTS && !sent; attempt++) {
+                    attempts++;
+                    latency += options.airtimeMs * 2;  // Attempt plus the wait for its ACK
+                    sent = uniform(random) >= frameLoss;
+                }
+                if (!sent) {
+                    latency += rto;
+                    rto *= 2;
+                    if (latency > options.timeoutMs) {
+                        latency = options.timeoutMs;
+                        delivered = false;
+                        break;
+                    }
+                }
+            }
+        }
+
+        double txMs = attempts * options.airtimeMs;
+        result.attempts += attempts;
+        result.delivered += delivered;
+        result.slow += delivered && latency > TX_POWER_LATENCY_TARGET;
+        result.latencyMs += latency;
+        result.txChargeMaMs += txMs * txCurrentMa(dbm);
+        result.chargeMaMs += txMs * txCurrentMa(dbm) + (latency - txMs) * options.rxMa;
+        result.powerDbm += dbm;
+
+        if (controlled) {
+            controller.noteUpload(delivered, (uint32_t)latency, (int)lround(rssi + measurement(random)));
+            result.levelChanges += controller.getLevelIndex() != before;
+        }
+    }
+    return result;
+}
+
+static void report(const char* name, const Result& result, const Options& options) {
+    double uploads = options.uploads;
+    printf("%-10s delivered %6.2f%%  slow %4u  latency %6.0f ms  attempts/upload %5.2f  "
+           "power %5.2f dBm  tx %6.3f mAs  radio %6.2f mAs per upload",
+           name, 100.0 * result.delivered / uploads, (unsigned)result.slow, result.latencyMs / uploads,
+           result.attempts / uploads, result.powerDbm / uploads, result.txChargeMaMs / uploads / 1000,
+           result.chargeMaMs / uploads / 1000);
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --uploads N            uploads to simulate (default 2000)\n"
+            "  --rssi DBM             signal the device hears from the AP (default -45)\n"
+            "  --sensitivity DBM      uplink signal at which half the frames are lost (default -80)\n"
+            "  --fade DB              standard deviation of slow fading (default 4)\n"
+            "  --frames N             frames sent per upload (default 6)\n"
+            "  --airtime MS           air time of one transmission attempt (default 0.5)\n"
+            "  --move-at N            move the device after N uploads (default never)\n"
+            "  --move-rssi DBM        signal from the AP after the move (default -70)\n"
+            "  --second-ap DBM        alternate with a second AP heard at this signal\n"
+            "  --switch-every N       uploads between AP switches (default 100)\n"
+            "  --seed N               random seed (default 1)\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    static const option longOptions[] = {
+        {"uploads", required_argument, nullptr, 'u'},
+        {"rssi", required_argument, nullptr, 'r'},
+        {"sensitivity", required_argument, nullptr, 's'},
+        {"fade", required_argument, nullptr, 'f'},
+        {"frames", required_argument, nullptr, 'n'},
+        {"airtime", required_argument, nullptr, 't'},
+        {"move-at", required_argument, nullptr, 'm'},
+        {"move-rssi", required_argument, nullptr, 'M'},
+        {"second-ap", required_argument, nullptr, 'a'},
+        {"switch-every", required_argument, nullptr, 'w'},
+        {"seed", required_argument, nullptr, 'S'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'u': opt.uploads = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'r': opt.rssi = atof(optarg); break;
+            case 's': opt.sensitivity = atof(optarg); break;
+            case 'f': opt.fade = atof(optarg); break;
+            case 'n': opt.frames = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 't': opt.airtimeMs = atof(optarg); break;
+            case 'm': opt.moveAt = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'M': opt.moveRssi = atof(optarg); break;
+            case 'a': opt.secondAp = atof(optarg); break;
+            case 'w': opt.switchEvery = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'S': opt.seed = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            default: return false;
+        }
+    }
+    return optind == argc && opt.uploads > 0 && opt.frames > 0 && opt.airtimeMs > 0 && opt.switchEvery > 0 && opt.fade >= 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Result fixed = simulate(options, false);
+    Result controlled = simulate(options, true);
+
+    report("full power", fixed, options);
+    printf("\n");
+    report("controlled", controlled, options);
+    printf("  level changes %u\n", (unsigned)controlled.levelChanges);
+    printf("saved: %.1f%% of transmit charge, %.1f%% of radio charge\n",
+           100.0 * (1 - controlled.txChargeMaMs / fixed.txChargeMaMs),
+           100.0 * (1 - controlled.chargeMaMs / fixed.chargeMaMs));
+    return 0;
+}